@@ -0,0 +1,56 @@
+#include "Image.h"
+#include "bench_util.h"
+#include "dithering.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+/**
+ * @brief Returns whether two images of the same shape have the same samples.
+ */
+static bool same_samples(const Image &a, const Image &b) {
+  const size_t span = (size_t)a.width() * a.channels();
+  for (uint i = 0; i < a.height(); i++) {
+    if (memcmp(a.row(i), b.row(i), span) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Times dither_inplace() on a large image for 1 to N threads and
+ * checks that every thread count gives the 1-thread result.
+ *
+ * N is the number of hardware threads, or the first argument.
+ */
+int main(int argc, char **argv) {
+  uint max_threads =
+      argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  max_threads = max_threads > 0 ? max_threads : 1;
+  const Image source = noise_image(8000, 6000, 3);
+  const double pixels = (double)source.width() * source.height();
+  int status = 0;
+  for (uint dim : {8u, 16u}) {
+    const THRESHOLD_STRIPS strips = threshold_strips(dim, source.channels());
+    Image expected = source;
+    dither_inplace(expected, strips, 0, 1);
+    printf("dither_inplace %ux%ux%u, %ux%u matrix\n", source.width(),
+           source.height(), source.channels(), dim, dim);
+    double single = 0;
+    for (uint threads = 1; threads <= max_threads; threads++) {
+      Image image;
+      const double ms =
+          best_ms([&] { image = source; },
+                  [&] { dither_inplace(image, strips, 0, threads); });
+      single = threads == 1 ? ms : single;
+      const bool same = same_samples(image, expected);
+      printf("  %3u threads %8.2f ms %8.1f Mpx/s  speedup %5.2f  %s\n",
+             threads, ms, pixels / ms / 1e3, single / ms,
+             same ? "identical" : "DIFFERS");
+      status |= !same;
+    }
+  }
+  return status;
+}
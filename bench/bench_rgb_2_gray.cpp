@@ -0,0 +1,30 @@
+#include "Image.h"
+#include "bench_util.h"
+#include <cstdio>
+
+/**
+ * @brief The double precision loop that rgb_2_gray() replaced.
+ */
+static void reference_gray(const Image &image, Image &gray) {
+  for (uint i = 0; i < image.height(); i++) {
+    for (uint j = 0; j < image.width(); j++) {
+      gray.set(i, j, 0,
+               0.257 * image.get(i, j, 0) + 0.504 * image.get(i, j, 1) +
+                   0.098 * image.get(i, j, 2) + 16);
+    }
+  }
+}
+
+int main() {
+  const Image image = noise_image(4000, 3000, 3);
+  const double pixels = (double)image.width() * image.height();
+  Image gray(image.width(), image.height(), 1);
+  const double reference = best_ms([&] { reference_gray(image, gray); });
+  const double fixed = best_ms([&] { gray = image.rgb_2_gray(); });
+  printf("rgb_2_gray %ux%u\n", image.width(), image.height());
+  printf("  double loop  %8.2f ms %8.1f Mpx/s\n", reference,
+         pixels / reference / 1e3);
+  printf("  fixed point  %8.2f ms %8.1f Mpx/s\n", fixed,
+         pixels / fixed / 1e3);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include "Image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Returns the fastest of several runs of a function, in milliseconds.
+ * @param run The function.
+ * @param repeats Number of runs.
+ */
+template <typename RUN> double best_ms(RUN run, uint repeats = 5) {
+  double best = 1e300;
+  for (uint r = 0; r < repeats; r++) {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/**
+ * @brief Returns the fastest of several runs of a function that modifies its
+ * input, in milliseconds, preparing the input before every run untimed.
+ * @param setup Prepares the input.
+ * @param run The function.
+ * @param repeats Number of runs.
+ */
+template <typename SETUP, typename RUN>
+double best_ms(SETUP setup, RUN run, uint repeats = 5) {
+  double best = 1e300;
+  for (uint r = 0; r < repeats; r++) {
+    setup();
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/**
+ * @brief Makes an image of uniform noise.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of channels.
+ */
+inline Image noise_image(uint width, uint height, uint channels) {
+  Image image(width, height, channels);
+  uint32_t state = 2463534242u;
+  for (uint i = 0; i < height; i++) {
+    BYTE *row = image.row(i);
+    for (size_t j = 0; j < (size_t)width * channels; j++) {
+      // xorshift32
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      row[j] = state >> 24;
+    }
+  }
+  return image;
+}
+
+#endif
@@ -13,11 +13,18 @@ def main():
     bw_dith_path = os.path.join(BASE_DIR, f"{IMAGE_NAME}_dith_bw.jpg")
     bw_error_path = os.path.join(BASE_DIR, f"{IMAGE_NAME}_mbvq_bw.jpg")
 
-    os.system(f"./image_print --input={file_path} --output={color_dith_path} --op=1 --size=16")
-    os.system(f"./image_print --input={file_path} --output={color_error_path} --op=2 --kernel=3 --threshold=127 --mbvq=0")
-    os.system(f"./image_print --input={file_path} --output={color_mbvq_path} --op=2 --kernel=3 --threshold=127 --mbvq=1")
-    os.system(f"./image_print --input={file_path} --output={bw_dith_path} --op=1 --size=16 --bw=1")
-    os.system(f"./image_print --input={file_path} --output={bw_error_path} --op=2 --kernel=3 --threshold=127 --mbvq=0 --bw=1")
+    variants = [
+        (color_dith_path, "--op=1 --size=16"),
+        (color_error_path, "--op=2 --kernel=3 --threshold=127 --mbvq=0"),
+        (color_mbvq_path, "--op=2 --kernel=3 --threshold=127 --mbvq=1"),
+        (bw_dith_path, "--op=1 --size=16 --bw=1"),
+        (bw_error_path, "--op=2 --kernel=3 --threshold=127 --mbvq=0 --bw=1"),
+    ]
+    manifest_path = os.path.join(BASE_DIR, "manifest.txt")
+    with open(manifest_path, "w") as manifest:
+        for path, options in variants:
+            manifest.write(f"{file_path} {path} {options}\n")
+    os.system(f"./image_print --batch={manifest_path}")
 
     all_paths = [file_path, color_dith_path, color_error_path, color_mbvq_path, bw_dith_path, bw_error_path]
 
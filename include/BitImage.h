@@ -0,0 +1,153 @@
+#ifndef BIT_IMAGE_H
+#define BIT_IMAGE_H
+
+#include "Image.h"
+#include <cstddef>
+
+/**
+ * @class BitImage
+ * @brief Represents a halftoned image with one bit per sample.
+ *
+ * Every sample of a halftone is 0 or 255, so a BitImage keeps 1/8 of the
+ * memory of the equivalent Image. The bits of a row follow the samples of
+ * the Image row they come from: all samples of the row in pixel order for
+ * INTERLEAVED, one row per channel for PLANAR. They are packed 8 per byte
+ * with the first sample in the most significant bit, and a set bit is a
+ * sample that is off (0), the black of PBM. Rows start at multiples of
+ * IMAGE_ALIGNMENT bytes and the bits past the end of a row are zero, so a
+ * single channel row is a PBM row as is.
+ *
+ * The halftoning kernels write into a BitImage directly, see dither() and
+ * ErrorDiffuser::pop(), and toImage() expands it back for the JPG encoder.
+ */
+class BitImage {
+private:
+  uint _width, _height, _channels; /**< Image dimensions and number of channels. */
+  LAYOUT _layout;                  /**< Arrangement of the channels. */
+  size_t _stride;                  /**< Distance in bytes between two rows. */
+  size_t _plane;                   /**< Distance in bytes between two channels. */
+  BUFFER _buffer;                  /**< Contiguous container to store the bits. */
+
+public:
+  /**
+   * @brief Default constructor.
+   */
+  BitImage();
+
+  /**
+   * @brief Parameterized constructor to initialize an image with given
+   * dimensions, all samples 255.
+   * @param width Image width.
+   * @param height Image height.
+   * @param channels Number of color channels.
+   * @param layout Arrangement of the channels in memory (default INTERLEAVED).
+   */
+  BitImage(uint width, uint height, uint channels,
+           LAYOUT layout = INTERLEAVED);
+
+  /**
+   * @brief Packs an image, a sample below 128 becomes 0 and any other 255.
+   * @param image The image, with its layout.
+   */
+  explicit BitImage(const Image &image);
+
+  /**
+   * @brief Sets the dimensions of the image, all samples 255. The buffer is
+   * reused when it is large enough.
+   * @param width Image width.
+   * @param height Image height.
+   * @param channels Number of color channels.
+   * @param layout Arrangement of the channels in memory.
+   */
+  void resize(uint width, uint height, uint channels, LAYOUT layout);
+
+  /**
+   * @brief Returns the width of the image.
+   */
+  uint width() const;
+
+  /**
+   * @brief Returns the height of the image.
+   */
+  uint height() const;
+
+  /**
+   * @brief Returns the number of channels of the image.
+   */
+  uint channels() const;
+
+  /**
+   * @brief Returns the arrangement of the channels in memory.
+   */
+  LAYOUT layout() const;
+
+  /**
+   * @brief Returns the distance in bytes between the starts of two rows.
+   */
+  size_t stride() const;
+
+  /**
+   * @brief Returns the number of samples in a row of a single span, i.e.
+   * width * channels for INTERLEAVED and width for PLANAR.
+   */
+  size_t span() const;
+
+  /**
+   * @brief Returns a pointer to the first byte of row i, of channel k for
+   * PLANAR images.
+   * @param i Row index.
+   * @param k Channel index, 0 for INTERLEAVED images (default 0).
+   */
+  BYTE *row(uint i, uint k = 0);
+
+  /**
+   * @brief Returns a pointer to the first byte of row i, of channel k for
+   * PLANAR images.
+   * @param i Row index.
+   * @param k Channel index, 0 for INTERLEAVED images (default 0).
+   */
+  const BYTE *row(uint i, uint k = 0) const;
+
+  /**
+   * @brief Gets the sample at a specific location, 0 or 255.
+   * @param i Row index.
+   * @param j Column index.
+   * @param k Channel index.
+   */
+  BYTE get(uint i, uint j, uint k) const;
+
+  /**
+   * @brief Sets the sample at a specific location, to 0 for a value below
+   * 128 and to 255 otherwise.
+   * @param i Row index.
+   * @param j Column index.
+   * @param k Channel index.
+   * @param val Value to be set.
+   */
+  void set(uint i, uint j, uint k, BYTE val);
+
+  /**
+   * @brief Packs a row of an image with the same width, channels and layout
+   * into row i.
+   * @param i Row index.
+   * @param image The image.
+   * @param row Row index in image.
+   */
+  void pack_row(uint i, const Image &image, uint row);
+
+  /**
+   * @brief Expands row i into a row of an image with the same width,
+   * channels and layout.
+   * @param i Row index.
+   * @param image The image.
+   * @param row Row index in image.
+   */
+  void unpack_row(uint i, Image &image, uint row) const;
+
+  /**
+   * @brief Expands the image to 8 bits per sample, with the same layout.
+   */
+  Image toImage() const;
+};
+
+#endif
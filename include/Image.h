@@ -1,6 +1,11 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include "aligned_allocator.h"
+#include <cstddef>
+#ifdef IMAGE_COUNT_COPIES
+#include <atomic>
+#endif
 #include <iostream>
 #include <string>
 #include <vector>
@@ -18,98 +23,199 @@ typedef unsigned char BYTE;
 typedef unsigned int uint;
 
 /**
- * @typedef CRATE
- * @brief Represents a 3D matrix containing BYTE elements.
+ * @brief Alignment in bytes of the image buffer and of every image row.
+ */
+const size_t IMAGE_ALIGNMENT = 64;
+
+class JpegReader;
+
+/**
+ * @typedef BUFFER
+ * @brief Contiguous, aligned storage holding all samples of an image.
+ */
+typedef std::vector<BYTE, AlignedAllocator<BYTE, IMAGE_ALIGNMENT>> BUFFER;
+
+/**
+ * @enum LAYOUT
+ * @brief Defines how the channels of an image are arranged in memory.
  */
-typedef std::vector<std::vector<std::vector<BYTE>>> CRATE;
+enum LAYOUT {
+  INTERLEAVED, ///< Samples of a pixel are adjacent (RGBRGB...).
+  PLANAR       ///< Each channel is stored as a separate plane (RR..GG..BB..).
+};
 
 /**
  * @class Image
  * @brief Represents an image object with functionalities for basic manipulations and file IO.
+ *
+ * The samples are stored in one contiguous, aligned buffer. Every row starts
+ * at a multiple of IMAGE_ALIGNMENT bytes; the distance between two rows is
+ * given by stride(). The sample (i, j, k) lives at
+ * `row(i, k)[j * step()]` for both layouts.
  */
 class Image {
 private:
   uint _width, _height, _channels; /**< Image dimensions and number of channels. */
-  CRATE _crate;                    /**< 3D container to store image data. */
-  
-  /** 
-   * @brief Normalizes the image data.
-   */
-  void _normalize();
+  LAYOUT _layout;                  /**< Arrangement of the channels. */
+  size_t _stride;                  /**< Distance in bytes between two rows. */
+  size_t _plane;                   /**< Distance in bytes between two channels. */
+  size_t _step;                    /**< Distance in bytes between two pixels. */
+  BUFFER _buffer;                  /**< Contiguous container to store image data. */
 
-  /** 
-   * @brief Denormalizes the image data.
+  /**
+   * @brief Computes the stride, plane and step for the current dimensions
+   * and allocates a zero initialized buffer.
    */
-  void _denormalize();
+  void _allocate();
 
 public:
-  /** 
+#ifdef IMAGE_COUNT_COPIES
+  /**
+   * @brief Number of image buffers duplicated by the copy constructor and
+   * the copy assignment, compiled in for the tests.
+   */
+  static std::atomic<size_t> copies;
+#endif
+
+  /**
    * @brief Default constructor.
    */
-  Image() {}
+  Image();
 
   /**
    * @brief Parameterized constructor to initialize image with given dimensions.
    * @param width Image width.
    * @param height Image height.
    * @param channels Number of color channels.
+   * @param layout Arrangement of the channels in memory (default INTERLEAVED).
    */
-  Image(uint width, uint height, uint channels);
+  Image(uint width, uint height, uint channels, LAYOUT layout = INTERLEAVED);
 
   /**
-   * @brief Assignment operator.
+   * @brief Copy constructor, duplicates the image buffer.
+   */
+  Image(const Image &other);
+
+  /**
+   * @brief Move constructor, takes over the image buffer and leaves
+   * the source empty.
+   */
+  Image(Image &&other) noexcept;
+
+  /**
+   * @brief Copy assignment operator, duplicates the image buffer.
    */
   Image &operator=(const Image &rhs);
 
   /**
-   * @brief Addition operator to add two images.
+   * @brief Move assignment operator, takes over the image buffer and leaves
+   * the source empty.
+   */
+  Image &operator=(Image &&rhs) noexcept;
+
+  /**
+   * @brief Addition operator to add two images, saturating at 255.
    */
   Image operator+(const Image &rhs);
 
   /**
-   * @brief Subtraction operator to subtract two images.
+   * @brief Subtraction operator to subtract two images, saturating at 0.
    */
   Image operator-(const Image &rhs);
 
   /**
-   * @brief Addition operator to add a constant value to an image.
+   * @brief Addition operator to add a constant value to an image (brightness),
+   * saturating at 0 and 255.
    */
   Image operator+(const int &rhs);
 
   /**
-   * @brief Addition assignment operator.
+   * @brief Addition assignment operator, saturating at 0 and 255.
    */
-  Image operator+=(const int &rhs);
+  Image &operator+=(const int &rhs);
 
   /**
-   * @brief Subtraction operator to subtract a constant value from an image.
+   * @brief Subtraction operator to subtract a constant value from an image,
+   * saturating at 0 and 255.
    */
   Image operator-(const int &rhs);
 
   /**
-   * @brief Subtraction assignment operator.
+   * @brief Subtraction assignment operator, saturating at 0 and 255.
    */
-  Image operator-=(const int &rhs);
+  Image &operator-=(const int &rhs);
 
   /**
-   * @brief Multiplication operator to multiply image with a constant.
+   * @brief Multiplication operator to multiply image with a constant
+   * (contrast), saturating at 0 and 255.
    */
   Image operator*(const int &rhs);
 
+  /**
+   * @brief Multiplication assignment operator, saturating at 0 and 255.
+   */
+  Image &operator*=(const int &rhs);
+
   /**
    * @brief Returns the width of the image.
    */
-  uint width();
+  uint width() const;
 
   /**
    * @brief Returns the height of the image.
    */
-  uint height();
+  uint height() const;
 
   /**
    * @brief Returns the number of channels of the image.
    */
-  uint channels();
+  uint channels() const;
+
+  /**
+   * @brief Returns the arrangement of the channels in memory.
+   */
+  LAYOUT layout() const;
+
+  /**
+   * @brief Returns the distance in bytes between the starts of two rows.
+   */
+  size_t stride() const;
+
+  /**
+   * @brief Returns the distance in bytes between two consecutive samples of
+   * the same channel within a row (channels for INTERLEAVED, 1 for PLANAR).
+   */
+  size_t step() const;
+
+  /**
+   * @brief Returns the number of samples in a row of a single span, i.e.
+   * width * channels for INTERLEAVED and width for PLANAR.
+   */
+  size_t span() const;
+
+  /**
+   * @brief Returns a pointer to the first sample of the buffer.
+   */
+  BYTE *data();
+
+  /**
+   * @brief Returns a pointer to the first sample of the buffer.
+   */
+  const BYTE *data() const;
+
+  /**
+   * @brief Returns a pointer to the first sample of channel k in row i.
+   * @param i Row index.
+   * @param k Channel index (default 0).
+   */
+  BYTE *row(uint i, uint k = 0);
+
+  /**
+   * @brief Returns a pointer to the first sample of channel k in row i.
+   * @param i Row index.
+   * @param k Channel index (default 0).
+   */
+  const BYTE *row(uint i, uint k = 0) const;
 
   /**
    * @brief Gets the value at a specific location in the image matrix.
@@ -117,7 +223,7 @@ public:
    * @param j Column index.
    * @param k Channel index.
    */
-  BYTE get(uint i, uint j, uint k);
+  BYTE get(uint i, uint j, uint k) const;
 
   /**
    * @brief Sets a value at a specific location in the image matrix.
@@ -131,35 +237,85 @@ public:
   /**
    * @brief Finds the maximum value in the image data.
    */
-  int max();
+  int max() const;
 
   /**
    * @brief Finds the minimum value in the image data.
    */
-  int min();
+  int min() const;
 
   /**
    * @brief Reads a JPG image from the specified file path.
    * @param filename Path to the JPG image.
+   * @param scale Decode at 1/scale of the size: 1, 2, 4 or 8.
+   * @param fast_dct Use the fast integer IDCT.
+   * @param gray Decode color images as grayscale from their luma.
+   * @param threads Number of threads, 0 for one per hardware thread
+   *                (default 1). JPGs with restart markers are decoded in
+   *                strips in parallel, see read_jpg_strips().
+   * @return bool False if the file could not be opened.
    */
-  void readJpg(const std::string &filename);
+  bool readJpg(const std::string &filename, uint scale = 1,
+               bool fast_dct = false, bool gray = false, uint threads = 1);
 
   /**
-   * @brief Writes the image data to a JPG file.
+   * @brief Reads a JPG image held in memory, e.g. a memory-mapped file.
+   * @param data The JPG data.
+   * @param size Size of the JPG data in bytes.
+   * @param scale Decode at 1/scale of the size: 1, 2, 4 or 8.
+   * @param fast_dct Use the fast integer IDCT.
+   * @param gray Decode color images as grayscale from their luma.
+   * @param threads Number of threads, 0 for one per hardware thread
+   *                (default 1). JPGs with restart markers are decoded in
+   *                strips in parallel, see read_jpg_strips().
+   */
+  void readJpg(const BYTE *data, size_t size, uint scale = 1,
+               bool fast_dct = false, bool gray = false, uint threads = 1);
+
+  /**
+   * @brief Reads the rest of a JPG image from an opened reader and closes
+   * it. The buffer of the image is reused when it is large enough.
+   * @param reader Reader that was opened on the JPG image.
+   */
+  void readJpg(JpegReader &reader);
+
+  /**
+   * @brief Writes the image data to a JPG file, as a grayscale JPG for a
+   * single channel image.
    * @param filename Path to save the JPG image.
    * @param quality Quality of the saved JPG image (default is 75).
+   * @param threads Number of threads, 0 for one per hardware thread
+   *                (default 1). With more than one the JPG is encoded in
+   *                strips in parallel, see write_jpg_strips().
+   * @return bool False if the file could not be created.
+   */
+  bool writeJpg(const std::string &filename, int quality = 75,
+                uint threads = 1);
+
+  /**
+   * @brief Encodes the image data into a JPG in memory, as a grayscale JPG
+   * for a single channel image.
+   * @param buffer Receives the JPG, its capacity is reused.
+   * @param quality Quality of the JPG image (default is 75).
+   * @param threads Number of threads, 0 for one per hardware thread
+   *                (default 1). With more than one the JPG is encoded in
+   *                strips in parallel, see write_jpg_strips().
    */
-  void writeJpg(const std::string &filename, int quality = 75);
+  void writeJpg(std::vector<BYTE> &buffer, int quality = 75,
+                uint threads = 1);
 
   /**
    * @brief Creates a new image with the same dimensions but without data.
    */
-  Image like();
+  Image like() const;
 
   /**
    * @brief Converts a RGB image to grayscale.
+   *
+   * Uses the fixed-point kernel rgb_to_gray(), see simd.h for its tolerance
+   * against the double precision formula. Grayscale images are returned as is.
    */
-  Image rgb_2_gray();
+  Image rgb_2_gray() const;
 };
 
 #endif
@@ -0,0 +1,67 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @class AlignedAllocator
+ * @brief Standard allocator returning memory aligned to a fixed boundary.
+ *
+ * Used as the allocator of the image buffers so that every row starts on a
+ * cache line and can be processed with aligned vector loads and stores.
+ *
+ * @tparam T Element type.
+ * @tparam ALIGNMENT Alignment in bytes (power of 2, at least sizeof(void *)).
+ */
+template <typename T, std::size_t ALIGNMENT> class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  template <typename U> struct rebind {
+    typedef AlignedAllocator<U, ALIGNMENT> other;
+  };
+
+  AlignedAllocator() noexcept {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, ALIGNMENT> &) noexcept {}
+
+  /**
+   * @brief Allocates uninitialized storage for n elements.
+   * @param n Number of elements.
+   */
+  T *allocate(std::size_t n) {
+    if (n == 0) {
+      return nullptr;
+    }
+    // aligned_alloc requires the size to be a multiple of the alignment
+    std::size_t bytes = (n * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    void *ptr = std::aligned_alloc(ALIGNMENT, bytes);
+    if (!ptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(ptr);
+  }
+
+  /**
+   * @brief Releases storage obtained from allocate().
+   * @param ptr Pointer to the storage.
+   */
+  void deallocate(T *ptr, std::size_t) noexcept { std::free(ptr); }
+};
+
+template <typename T, typename U, std::size_t ALIGNMENT>
+bool operator==(const AlignedAllocator<T, ALIGNMENT> &,
+                const AlignedAllocator<U, ALIGNMENT> &) {
+  return true;
+}
+
+template <typename T, typename U, std::size_t ALIGNMENT>
+bool operator!=(const AlignedAllocator<T, ALIGNMENT> &,
+                const AlignedAllocator<U, ALIGNMENT> &) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "pipeline.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct BATCH_JOB
+ * @brief One image of a batch run.
+ */
+struct BATCH_JOB {
+  std::string input;  ///< Path to the input JPG image.
+  std::string output; ///< Path to save the output JPG, PBM or PAM image.
+  PIPELINE pipeline;  ///< The stages to apply.
+};
+
+/**
+ * @struct BATCH_REPORT
+ * @brief Aggregate result of a batch run.
+ */
+struct BATCH_REPORT {
+  uint images = 0;     ///< Number of images written.
+  uint failures = 0;   ///< Number of images that failed.
+  uint64_t pixels = 0; ///< Number of pixels of the written images.
+  double seconds = 0;  ///< Wall time of the run.
+};
+
+/**
+ * @brief Lists the JPG images (.jpg or .jpeg) of a directory.
+ *
+ * @param directory Path to the directory.
+ * @return std::vector<std::string> File names, sorted.
+ * @throws std::invalid_argument if the directory cannot be read.
+ */
+std::vector<std::string> list_images(const std::string &directory);
+
+/**
+ * @brief Processes a list of images on a fixed pool of workers.
+ *
+ * Every worker takes the next job from a shared counter and keeps its JPG
+ * decoder, encoders and image buffer for all the images it processes. The
+ * images run in parallel, so the threads of the job pipelines are ignored
+ * and every image is processed on the thread of its worker. A
+ * failing image is reported on the standard error stream, its partial
+ * output is removed and the run continues with the next image.
+ *
+ * @param jobs Images to process.
+ * @param workers Number of images processed at once, 0 for one per core.
+ * @return BATCH_REPORT Aggregate throughput and number of failures.
+ */
+BATCH_REPORT process_batch(const std::vector<BATCH_JOB> &jobs, uint workers);
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef BILEVEL_H
+#define BILEVEL_H
+
+#include "BitImage.h"
+#include "Image.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @enum OUTPUT_FORMAT
+ * @brief Enumerates the formats of the output image.
+ */
+enum OUTPUT_FORMAT {
+  JPG = 1, ///< Lossy JPG, 8 bits per sample.
+  PBM = 2, ///< Binary PBM (P4), 1 bit per sample.
+  PAM = 3  ///< PAM (P7) with a maximum value of 1, 1 byte per sample.
+};
+
+/**
+ * @brief Returns the output format of a file name from its extension.
+ *
+ * `.pbm` and `.pam` (in any case) select the bilevel formats, every other
+ * name, including `-` for the standard output, is written as a JPG.
+ *
+ * @param filename Path of the output image.
+ * @return OUTPUT_FORMAT The format to write.
+ */
+OUTPUT_FORMAT output_format(const std::string &filename);
+
+/**
+ * @brief Returns the path an output image is written to until it is
+ * complete.
+ *
+ * A new file or an existing regular file is written to a temporary file in
+ * the same directory, which finish_output() renames in place or removes, so
+ * a failed write neither leaves a partial image nor destroys the previous
+ * one. `-`, devices, pipes and symbolic links are written directly and are
+ * never removed.
+ *
+ * @param filename Path of the output image.
+ * @return std::string Path to write the image to.
+ */
+std::string partial_output(const std::string &filename);
+
+/**
+ * @brief Completes or discards an output written to partial_output().
+ * @param partial Path returned by partial_output().
+ * @param filename Path of the output image.
+ * @param complete Whether the image was written completely. A complete
+ *                 temporary file is renamed to filename, an incomplete one
+ *                 is removed.
+ * @throws std::runtime_error if the temporary file cannot be renamed.
+ */
+void finish_output(const std::string &partial, const std::string &filename,
+                   bool complete);
+
+/**
+ * @class BilevelWriter
+ * @brief Writes the rows of a halftoned Image into a PBM or PAM file.
+ *
+ * The samples of a halftone are 0 or 255, so they are stored losslessly with
+ * one bit (PBM) or one byte (PAM) each, a sample below 128 being black.
+ *
+ * - PBM packs 8 pixels per byte, with a set bit for black. A color image is
+ *   written as one PBM image per channel in the same file, in R, G and B
+ *   order, so every image shows where its channel is off, i.e. the cyan,
+ *   magenta and yellow ink. The images are filled row by row in place when
+ *   the file can seek, otherwise the packed G and B planes are kept until
+ *   close().
+ * - PAM keeps the pixels interleaved with TUPLTYPE BLACKANDWHITE or RGB, for
+ *   tools that expect a single color image.
+ *
+ * Like JpegWriter, a writer can be reused after close(), writes the standard
+ * output for the file name `-` and throws write errors as
+ * std::runtime_error.
+ */
+class BilevelWriter {
+private:
+  FILE *_file;                /**< Opened output file. */
+  OUTPUT_FORMAT _format;      /**< Format of the file. */
+  uint _width;                /**< Image width. */
+  uint _height;               /**< Image height. */
+  uint _channels;             /**< Channels of the file: 1 or 3. */
+  uint _scanline;             /**< Index of the next row. */
+  bool _seekable;             /**< Whether the PBM planes are seeked to. */
+  long _origin;               /**< Offset of the first PBM image. */
+  std::string _header;        /**< Header of every PBM image. */
+  std::vector<BYTE> _scratch; /**< Rows converted to the output. */
+  std::vector<BYTE> _samples; /**< One channel of a row, gathered. */
+  std::vector<BYTE> _planes;  /**< PBM images kept until close(). */
+  Image _unpacked;            /**< Rows of a BitImage expanded for PAM. */
+
+  /**
+   * @brief Writes bytes at the current position of the file.
+   */
+  void _put(const void *data, size_t bytes);
+
+  /**
+   * @brief Packs rows of an image into the scratch buffer, plane by plane.
+   */
+  void _pack_planes(const Image &image, uint first, uint rows);
+
+  /**
+   * @brief Copies rows of a BitImage into the scratch buffer, plane by
+   * plane.
+   */
+  void _pack_planes(const BitImage &bits, uint first, uint rows);
+
+  /**
+   * @brief Writes the planes of the scratch buffer into every PBM image.
+   */
+  void _put_planes(uint rows);
+
+public:
+  /**
+   * @brief Default constructor.
+   */
+  BilevelWriter();
+
+  /**
+   * @brief Destructor, closes the file.
+   */
+  ~BilevelWriter();
+
+  BilevelWriter(const BilevelWriter &) = delete;
+  BilevelWriter &operator=(const BilevelWriter &) = delete;
+
+  /**
+   * @brief Creates a PBM or PAM file and writes its header.
+   * @param filename Path to save the image.
+   * @param width Image width.
+   * @param height Image height.
+   * @param channels Channels of the image: 1 for black and white or 3 for RGB.
+   * @param format PBM or PAM.
+   * @return bool False if the file could not be created.
+   */
+  bool open(const std::string &filename, uint width, uint height,
+            uint channels, OUTPUT_FORMAT format);
+
+  /**
+   * @brief Returns the index of the next row to be written.
+   */
+  uint scanline() const;
+
+  /**
+   * @brief Writes rows [first, first + rows) of an image as the next rows.
+   *
+   * Contiguous channels are packed straight from their rows with
+   * pack_bits() and INTERLEAVED RGB rows with pack_rgb_bits(), other
+   * strided channels are gathered into a row first.
+   *
+   * @param image Source with the width of the file, a single channel is
+   *              replicated into all channels of the file.
+   * @param first First source row.
+   * @param rows Number of rows to write.
+   */
+  void write(const Image &image, uint first, uint rows);
+
+  /**
+   * @brief Writes rows [first, first + rows) of a halftone as the next rows.
+   *
+   * The bits are a PBM row already, so single channel and PLANAR rows are
+   * copied and INTERLEAVED RGB rows are split with split_rgb_bits(). For a
+   * PAM the rows are expanded to samples first.
+   *
+   * @param bits Source with the width of the file, a single channel is
+   *             replicated into all channels of the file.
+   * @param first First source row.
+   * @param rows Number of rows to write.
+   */
+  void write(const BitImage &bits, uint first, uint rows);
+
+  /**
+   * @brief Closes the file, after writing the kept PBM images of an image
+   * that was written to the end.
+   */
+  void close();
+};
+
+/**
+ * @brief Writes a halftone to a PBM or PAM file.
+ * @param bits The halftone, with 1 or 3 channels.
+ * @param filename Path to save the image.
+ * @param format PBM or PAM.
+ * @return bool False if the file could not be created.
+ */
+bool write_bilevel(const BitImage &bits, const std::string &filename,
+                   OUTPUT_FORMAT format);
+
+#endif
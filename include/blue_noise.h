@@ -0,0 +1,68 @@
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include "dithering.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Smallest dimension of a blue-noise mask.
+ */
+const unsigned int BLUE_NOISE_MIN_DIM = 8;
+
+/**
+ * @brief Largest dimension of a blue-noise mask, its ranks fit in 16 bits.
+ */
+const unsigned int BLUE_NOISE_MAX_DIM = 256;
+
+/**
+ * @brief Generates a blue-noise mask with the void-and-cluster method.
+ *
+ * The mask is a toroidal dim x dim matrix holding every rank from 0 to
+ * dim * dim - 1 once. Ranks are assigned by repeatedly removing the tightest
+ * cluster or filling the largest void of a binary pattern, measured with a
+ * Gaussian filter that wraps around the edges, so the mask tiles without
+ * seams. The result is deterministic.
+ *
+ * Every flip updates the filtered pattern within the filter window and
+ * recomputes the minimum of the rows it reaches, so finding the next
+ * cluster or void only scans the dim row minima and one row. The cost grows
+ * with dim^3: a 256 x 256 mask takes about a third of a second, which is
+ * still worth caching with blue_noise_matrix().
+ *
+ * @param dim The dimension of the mask.
+ * @param sigma Standard deviation of the Gaussian filter in pixels.
+ * @return std::vector<uint16_t> The ranks, row by row.
+ */
+std::vector<uint16_t> void_and_cluster(unsigned int dim, double sigma = 1.5);
+
+/**
+ * @brief Returns the default path of the cached mask of a dimension.
+ *
+ * The masks are kept in `$XDG_CACHE_HOME/image_print`, `~/.cache/image_print`
+ * without XDG_CACHE_HOME, or the working directory without a home.
+ *
+ * @param dim The dimension of the mask.
+ * @return std::string Path of the cache file.
+ */
+std::string blue_noise_cache(unsigned int dim);
+
+/**
+ * @brief Returns the threshold matrix of a blue-noise mask, loaded from its
+ * cache file.
+ *
+ * The cache file holds a small header and the 16-bit ranks and is read
+ * whole. A missing or invalid file is replaced with a mask made by
+ * void_and_cluster(); if it cannot be written, the generated mask is used
+ * for this run only.
+ *
+ * @param dim The dimension of the mask, a power of 2 between
+ *            BLUE_NOISE_MIN_DIM and BLUE_NOISE_MAX_DIM.
+ * @param cache Path of the cache file.
+ * @return mCRATE The threshold matrix.
+ * @throws std::invalid_argument if dim is not supported.
+ */
+mCRATE blue_noise_matrix(unsigned int dim, const std::string &cache);
+
+#endif
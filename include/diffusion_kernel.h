@@ -1,6 +1,9 @@
 #ifndef DIFFUSION_KERNEL_H
 #define DIFFUSION_KERNEL_H
 
+#include <cstdint>
+#include <vector>
+
 /**
  * @enum MBVQ
  * @brief Defines various modified barycentric vertex quantization (MBVQ) types.
@@ -46,7 +49,115 @@ enum COLOR {
 enum DIFFUSION_KERNEL {
   FLOYD_STEINBERG = 1,           ///< Represents the Floyd-Steinberg diffusion kernel.
   JARVIS_JUDICE_NINKE = 2,       ///< Represents the Jarvis-Judice-Ninke diffusion kernel.
-  STUCKI = 3                     ///< Represents the Stucki diffusion kernel.
+  STUCKI = 3,                    ///< Represents the Stucki diffusion kernel.
+  CUSTOM = 4                     ///< Represents a kernel loaded at runtime.
+};
+
+/**
+ * @struct KERNEL_TAPS
+ * @brief Non-zero taps of a diffusion kernel, known at compile time.
+ *
+ * Specializations give how far the kernel reaches down, left and right, the
+ * common denominator of the weights and an apply() that calls
+ * `tap(row, col, numerator)` once per non-zero tap, where row is the offset
+ * below and col the offset right of the current pixel for a left to right
+ * scan. The calls are written out so every tap is unrolled and the weights
+ * are constants.
+ */
+template <DIFFUSION_KERNEL KERNEL> struct KERNEL_TAPS;
+
+/**
+ * @brief Floyd-Steinberg taps.
+ */
+template <> struct KERNEL_TAPS<FLOYD_STEINBERG> {
+  static constexpr int rows = 1, left = 1, right = 1;
+  static constexpr int denominator = 16;
+  template <typename TAP> static void apply(TAP &&tap) {
+    tap(0, 1, 7);
+    tap(1, -1, 3);
+    tap(1, 0, 5);
+    tap(1, 1, 1);
+  }
+};
+
+/**
+ * @brief Jarvis-Judice-Ninke taps.
+ */
+template <> struct KERNEL_TAPS<JARVIS_JUDICE_NINKE> {
+  static constexpr int rows = 2, left = 2, right = 2;
+  static constexpr int denominator = 48;
+  template <typename TAP> static void apply(TAP &&tap) {
+    tap(0, 1, 7);
+    tap(0, 2, 5);
+    tap(1, -2, 3);
+    tap(1, -1, 5);
+    tap(1, 0, 7);
+    tap(1, 1, 5);
+    tap(1, 2, 3);
+    tap(2, -2, 1);
+    tap(2, -1, 3);
+    tap(2, 0, 5);
+    tap(2, 1, 3);
+    tap(2, 2, 1);
+  }
+};
+
+/**
+ * @brief Stucki taps.
+ */
+template <> struct KERNEL_TAPS<STUCKI> {
+  static constexpr int rows = 2, left = 2, right = 2;
+  static constexpr int denominator = 42;
+  template <typename TAP> static void apply(TAP &&tap) {
+    tap(0, 1, 8);
+    tap(0, 2, 4);
+    tap(1, -2, 2);
+    tap(1, -1, 4);
+    tap(1, 0, 8);
+    tap(1, 1, 4);
+    tap(1, 2, 2);
+    tap(2, -2, 1);
+    tap(2, -1, 2);
+    tap(2, 0, 4);
+    tap(2, 1, 2);
+    tap(2, 2, 1);
+  }
+};
+
+/**
+ * @brief Maximum number of rows below the current pixel a kernel can reach.
+ */
+const int KERNEL_MAX_ROWS = 7;
+
+/**
+ * @struct KERNEL_TAP
+ * @brief A non-zero tap of a kernel loaded at runtime, with its weight
+ * precomputed for the double and the fixed-point state.
+ */
+struct KERNEL_TAP {
+  int row;              ///< Offset below the current pixel.
+  int col;              ///< Offset right of the current pixel, left to right.
+  double weight;        ///< Weight of the tap.
+  int32_t fixed_weight; ///< Weight in fixed point, see FIXED_WEIGHT_BITS.
+};
+
+/**
+ * @struct CUSTOM_KERNEL
+ * @brief A diffusion kernel loaded at runtime as a sparse list of taps.
+ *
+ * Offers the same interface as KERNEL_TAPS, so it runs through the same
+ * diffusion code, with the taps visited in a loop instead of unrolled.
+ */
+struct CUSTOM_KERNEL {
+  int rows = 0, left = 0, right = 0; ///< Reach below, left and right.
+  int denominator = 1;               ///< Common denominator of the weights.
+  std::vector<KERNEL_TAP> taps;      ///< Non-zero taps.
+
+  template <typename TAP> void apply(TAP &&tap) const {
+    for (const KERNEL_TAP &t : this->taps) {
+      tap(t.row, t.col, t);
+    }
+  }
 };
 
 #endif
\ No newline at end of file
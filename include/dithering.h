@@ -1,7 +1,9 @@
 #ifndef DITHERING_H
 #define DITHERING_H
 
+#include "BitImage.h"
 #include "Image.h"
+#include <cstdint>
 #include <vector>
 
 /**
@@ -17,32 +19,130 @@ typedef unsigned char BYTE;
 typedef std::vector<std::vector<BYTE>> mCRATE;
 
 /**
- * @brief Generates a dithering matrix of specified dimensions.
+ * @brief Largest dimension of a Bayer matrix, its ranks fit in 16 bits.
+ */
+const unsigned int BAYER_MAX_DIM = 256;
+
+/**
+ * @struct BAYER_MATRIX
+ * @brief A Bayer dithering matrix held in static tables.
+ *
+ * The ranks order the cells from 0 to dim * dim - 1 and the thresholds
+ * spread them over 0-255. The tables of every dimension are generated at
+ * compile time, so no matrix is computed or allocated at runtime.
+ */
+struct BAYER_MATRIX {
+  unsigned int dim;       ///< Dimension of the matrix.
+  const uint16_t *ranks;  ///< The dim * dim ranks, row by row.
+  const BYTE *thresholds; ///< The dim * dim thresholds, row by row.
+};
+
+/**
+ * @brief Returns the Bayer matrix of specified dimensions.
+ *
+ * @param dim The dimension (rows and columns) of the matrix, a power of 2
+ *            between 2 and BAYER_MAX_DIM.
+ * @return BAYER_MATRIX The matrix.
+ * @throws std::invalid_argument if dim is not supported.
+ */
+BAYER_MATRIX bayer_matrix(unsigned int dim);
+
+/**
+ * @struct THRESHOLD_STRIPS
+ * @brief Holds a threshold matrix expanded into one strip per matrix row.
+ *
+ * Every strip repeats its matrix row with each threshold replicated for the
+ * samples of a pixel, so an image row is dithered by comparing it element
+ * by element against the strip, restarting the strip every `length` samples.
+ */
+struct THRESHOLD_STRIPS {
+  unsigned int dim;       ///< Dimension of the dithering matrix.
+  size_t length;          ///< Length of a strip, a multiple of the matrix period.
+  std::vector<BYTE> data; ///< The dim strips, one after the other.
+
+  /**
+   * @brief Returns the strip to be used for an image row.
+   * @param i Row index within the full image.
+   */
+  const BYTE *row(unsigned int i) const;
+};
+
+/**
+ * @brief Expands a square threshold matrix into strips. Image row i uses
+ * matrix row i % dim and image column j matrix column j % dim.
  *
- * The dithering matrix is often used for ordered dithering techniques where 
- * the matrix defines the threshold values for dithering.
+ * @param threshold The threshold matrix, e.g. from blue_noise_matrix().
+ * @param samples Samples per pixel in an image row: the number of channels
+ *                for INTERLEAVED images, 1 for PLANAR images.
+ * @return THRESHOLD_STRIPS The strips.
+ */
+THRESHOLD_STRIPS threshold_strips(const mCRATE &threshold,
+                                  unsigned int samples);
+
+/**
+ * @brief Expands the threshold matrix of the given dimension into strips.
  *
- * @param dim The dimension (rows and columns) of the dithering matrix.
- * @return mCRATE The generated dithering matrix.
+ * @param dim The dimension of the dithering matrix.
+ * @param samples Samples per pixel in an image row: the number of channels
+ *                for INTERLEAVED images, 1 for PLANAR images.
+ * @return THRESHOLD_STRIPS The strips.
  */
-mCRATE dithering_matrix(unsigned int dim);
+THRESHOLD_STRIPS threshold_strips(unsigned int dim, unsigned int samples);
 
 /**
- * @brief Converts a dithering matrix to a threshold matrix.
+ * @brief Performs dithering operation on an image in place with strips
+ * created for its layout by threshold_strips().
  *
- * A threshold matrix helps in deciding the pixel value based on a particular 
- * threshold during the dithering process.
+ * Rows are independent, so the image is split into horizontal bands whose
+ * height is a multiple of the matrix dimension and the bands are dithered
+ * in parallel. The result does not depend on the number of threads.
+ *
+ * @param image The image to be dithered.
+ * @param strips The threshold strips.
+ * @param offset Row index of the first row of image within the full image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void dither_inplace(Image &image, const THRESHOLD_STRIPS &strips,
+                    unsigned int offset = 0, unsigned int threads = 1);
+
+/**
+ * @brief Performs dithering operation on an image with strips created for
+ * its layout by threshold_strips(), writing the halftone as bits.
  *
- * @param dithering_matrix The source dithering matrix.
- * @return mCRATE The generated threshold matrix.
+ * The result is the one of dither_inplace() packed into a BitImage: every
+ * sample is compared with its threshold and the comparison mask is
+ * collected with movemask, so only 1/8 of the image is written and the
+ * source is left unchanged. Bands are dithered in parallel like in
+ * dither_inplace(); they are whole rows, so threads never share a byte.
+ *
+ * @param image The image to be dithered.
+ * @param bits Receives the halftone, resized to the shape of image unless
+ *             it already has it, so a batch buffer is reused.
+ * @param strips The threshold strips.
+ * @param offset Row index of the first row of image within the full image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void dither(const Image &image, BitImage &bits, const THRESHOLD_STRIPS &strips,
+            unsigned int offset = 0, unsigned int threads = 1);
+
+/**
+ * @brief Performs dithering operation on an image in place.
+ *
+ * Every sample is replaced by 0 or 255, so no output buffer is allocated.
+ *
+ * @param image The image to be dithered.
+ * @param dim The dimension of the dithering matrix to be used.
+ * @param offset Row index of the first row of image within the full image,
+ *               so that an image can be dithered in horizontal bands.
  */
-mCRATE threshold_matrix(mCRATE dithering_matrix);
+void dither_inplace(Image &image, unsigned int dim, unsigned int offset = 0);
 
 /**
  * @brief Performs dithering operation on an image.
  *
  * This function processes the input image using dithering with the specified 
- * dithering matrix dimension.
+ * dithering matrix dimension. Pass an rvalue (e.g. `std::move(image)`) to
+ * avoid copying the input.
  *
  * @param image The input image to be dithered.
  * @param dim The dimension of the dithering matrix to be used.
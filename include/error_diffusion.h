@@ -1,9 +1,11 @@
 #ifndef ERROR_DIFFUSION_H
 #define ERROR_DIFFUSION_H
 
+#include "BitImage.h"
 #include "Image.h"
 #include "diffusion_kernel.h"
-#include <map>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 /**
@@ -13,22 +15,20 @@
 typedef unsigned int uint;
 
 /**
- * @typedef VECTOR_DOUBLE_2D
- * @brief Represents a 2D matrix with double elements.
+ * @brief Fractional bits of the error diffusion state in fixed-point mode.
  */
-typedef std::vector<std::vector<double>> VECTOR_DOUBLE_2D;
+const int FIXED_STATE_BITS = 8;
 
 /**
- * @typedef VECTOR_DOUBLE_3D
- * @brief Represents a 3D matrix with double elements.
+ * @brief Fractional bits of the kernel weights in fixed-point mode.
  */
-typedef std::vector<VECTOR_DOUBLE_2D> VECTOR_DOUBLE_3D;
+const int FIXED_WEIGHT_BITS = 12;
 
 /**
- * @typedef VECTOR_BYTE
- * @brief Represents a vector of BYTE elements.
+ * @brief Rows diffused by every channel thread before an INTERLEAVED image
+ * receives them.
  */
-typedef std::vector<BYTE> VECTOR_BYTE;
+const uint DIFFUSION_BAND_ROWS = 64;
 
 /**
  * @brief Finds the nearest vertex for given RGB values based on a specific MBVQ type.
@@ -53,39 +53,223 @@ COLOR get_nearest_vertex(const MBVQ mbvq, const float R, const float G,
 MBVQ get_mbvq(BYTE R, BYTE G, BYTE B);
 
 /**
- * @brief Retrieves the color for a specific pixel in the 3D matrix based on a threshold.
+ * @brief Retrieves the color for a RGB pixel based on MBVQ technique.
  * 
- * @param ip_crate 3D matrix containing color data.
- * @param x X-coordinate of the pixel.
- * @param y Y-coordinate of the pixel.
- * @param threshold Threshold for deciding pixel color.
- * @return VECTOR_BYTE Vector containing the RGB values for the pixel.
+ * @param pixel Color data of the pixel, R, G and B.
+ * @return uint32_t Packed RGB values for the pixel, red in the lowest byte.
  */
-VECTOR_BYTE get_color(VECTOR_DOUBLE_3D &ip_crate, uint x, uint y,
-                      double threshold);
+uint32_t get_mbvq_color(const double *pixel);
 
 /**
- * @brief Retrieves the color for a specific pixel in the 3D matrix based on MBVQ technique.
- * 
- * @param ip_crate 3D matrix containing color data.
- * @param x X-coordinate of the pixel.
- * @param y Y-coordinate of the pixel.
- * @return VECTOR_BYTE Vector containing the RGB values for the pixel.
+ * @class ErrorDiffuser
+ * @brief Row by row error diffusion that keeps only as many rows of error
+ * state as the kernel is tall.
+ *
+ * Rows are pushed in order and popped in order once every row the kernel can
+ * reach from them has been pushed. The result is identical to
+ * error_diffusion() while the memory only depends on the image width.
  */
-VECTOR_BYTE get_mbvq_color(VECTOR_DOUBLE_3D &ip_crate, uint x, uint y);
+class ErrorDiffuser {
+private:
+  uint _width, _height, _channels;  /**< Image dimensions and number of channels. */
+  uint _stride;                     /**< Samples per pixel in the ring. */
+  uint _first;                      /**< First image channel handled. */
+  DIFFUSION_KERNEL _kernel_type;    /**< Type of diffusion kernel. */
+  CUSTOM_KERNEL _custom;            /**< Taps of a CUSTOM kernel. */
+  int _si;                          /**< Rows the kernel reaches below. */
+  bool _isMBVQ;                     /**< Whether MBVQ technique is used. */
+  double _threshold;                /**< Threshold for the error diffusion. */
+  bool _fixed;                      /**< Whether fixed-point state is used. */
+  std::vector<double> _window;      /**< Ring of _si + 1 rows of color data,
+                                         three channels padded to four. */
+  std::vector<int32_t> _fixed_window; /**< Ring of fixed-point color data. */
+  uint _pushed, _popped;            /**< Number of rows pushed and popped. */
+  Image _line;                      /**< Row popped before it is packed. */
+
+  /**
+   * @brief Allocates the ring of _si + 1 rows.
+   */
+  void _allocate();
+
+  /**
+   * @brief Returns the color data of row x in the ring of STATE.
+   */
+  template <typename STATE> STATE *_row(uint x);
+
+  /**
+   * @brief Diffuses the next row with the taps of TAPS.
+   */
+  template <typename TAPS>
+  void _diffuse(Image &image, uint i, const TAPS &taps);
+
+  /**
+   * @brief Diffuses the next row with the taps of TAPS and state of type
+   * STATE.
+   */
+  template <typename TAPS, typename STATE>
+  void _diffuse_state(Image &image, uint i, const TAPS &taps, bool reverse);
+
+  /**
+   * @brief Diffuses the next row with state of type STATE, scanning left to
+   * right when DIR is 1 and right to left with mirrored taps when DIR is -1.
+   * The channels share SIMD lanes when PACKED.
+   */
+  template <typename TAPS, int DIR, typename STATE, bool PACKED>
+  void _diffuse_row(Image &image, uint i, const TAPS &taps);
+
+  /**
+   * @brief Quantizes column y of the next row and diffuses its error to the
+   * rows in target. Taps are bounds checked only when CHECKED.
+   */
+  template <typename TAPS, int DIR, typename STATE, bool CHECKED>
+  void _pixel(Image &image, uint i, const TAPS &taps, STATE *const *target,
+              int rows, int y, STATE threshold);
+
+  /**
+   * @brief Quantizes column y of the next row of a three channel image and
+   * diffuses the error of all channels at once. Taps are bounds checked only
+   * when CHECKED.
+   */
+  template <typename TAPS, int DIR, typename STATE, bool CHECKED>
+  void _lanes_pixel(Image &image, uint i, const TAPS &taps,
+                    STATE *const *target, int rows, int y, STATE threshold);
+
+public:
+  /**
+   * @brief Constructor.
+   * @param width Image width.
+   * @param height Image height.
+   * @param channels Number of color channels.
+   * @param kernel_type Type of diffusion kernel to be used.
+   * @param isMBVQ Flag to determine if MBVQ technique is used.
+   * @param threshold Threshold for the error diffusion.
+   * @param first Index of the first image channel handled, so that
+   *              independent channels can be diffused separately.
+   * @param fixed Keep the state in fixed-point integers instead of doubles.
+   */
+  ErrorDiffuser(uint width, uint height, uint channels,
+                DIFFUSION_KERNEL kernel_type, bool isMBVQ, double threshold,
+                uint first = 0, bool fixed = false);
+
+  /**
+   * @brief Constructor for a kernel loaded at runtime.
+   * @param width Image width.
+   * @param height Image height.
+   * @param channels Number of color channels.
+   * @param kernel Taps of the kernel, see load_kernel().
+   * @param isMBVQ Flag to determine if MBVQ technique is used.
+   * @param threshold Threshold for the error diffusion.
+   * @param first Index of the first image channel handled.
+   * @param fixed Keep the state in fixed-point integers instead of doubles.
+   */
+  ErrorDiffuser(uint width, uint height, uint channels,
+                const CUSTOM_KERNEL &kernel, bool isMBVQ, double threshold,
+                uint first = 0, bool fixed = false);
+
+  /**
+   * @brief Returns whether the next row can be popped.
+   */
+  bool ready() const;
+
+  /**
+   * @brief Pushes the next input row.
+   * @param image Image holding the row.
+   * @param i Row index in image.
+   */
+  void push(const Image &image, uint i);
+
+  /**
+   * @brief Diffuses the next row and writes its halftone.
+   * @param image Image receiving the row, may be the pushed image.
+   * @param i Row index in image.
+   */
+  void pop(Image &image, uint i);
+
+  /**
+   * @brief Diffuses the next row and writes its halftone as bits, for a
+   * diffuser of all channels (first channel 0).
+   * @param bits Image receiving the row, with the channels of the diffuser.
+   * @param i Row index in bits.
+   */
+  void pop(BitImage &bits, uint i);
+};
 
 /**
- * @brief Flips the 2D kernel matrix horizontally (left-to-right).
+ * @brief Performs error diffusion on the provided image in place.
+ *
+ * Without MBVQ the channels do not interact and are diffused on separate
+ * threads. Rows cannot be overlapped: with the serpentine scan the first
+ * pixel of a row depends on the last pixels visited in the row above, so
+ * the result stays identical to the serial algorithm for any thread count.
+ * The threads of an INTERLEAVED image write to separate planes of a band of
+ * DIFFUSION_BAND_ROWS rows that is interleaved into the image afterwards.
+ *
+ * In fixed-point mode the state is kept in int32 with FIXED_STATE_BITS
+ * fractional bits and every weight is applied with a multiply by its value
+ * in FIXED_WEIGHT_BITS bits and a rounding shift. This halves the state
+ * memory, the halftone may differ from the double result in a few pixels.
  * 
- * @param kernel 2D matrix representing the kernel.
- * @return VECTOR_DOUBLE_2D Flipped kernel.
+ * @param image Image to be processed, overwritten with the result.
+ * @param kernel_type Type of diffusion kernel to be used.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param fixed Use fixed-point integer arithmetic instead of doubles.
+ */
+void error_diffusion_inplace(Image &image, DIFFUSION_KERNEL kernel_type,
+                             bool isMBVQ, double threshold, uint threads = 1,
+                             bool fixed = false);
+
+/**
+ * @brief Performs error diffusion on the provided image in place with a
+ * kernel loaded at runtime.
+ *
+ * @param image Image to be processed, overwritten with the result.
+ * @param kernel Taps of the kernel, see load_kernel().
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param fixed Use fixed-point integer arithmetic instead of doubles.
+ */
+void error_diffusion_inplace(Image &image, const CUSTOM_KERNEL &kernel,
+                             bool isMBVQ, double threshold, uint threads = 1,
+                             bool fixed = false);
+
+/**
+ * @brief Loads a diffusion kernel from a text file.
+ *
+ * Lines starting with `#` are comments. An optional line `divisor <n>` gives
+ * the denominator of the weights, it defaults to the sum of the weights. The
+ * other lines are the rows of the kernel matrix with one token per column:
+ * `X` marks the current pixel and has to be in the first row, `-` or `0` is
+ * a column without a tap and a positive integer is the numerator of a tap.
+ * The first row must not have taps left of `X`. Taps are given for a left to
+ * right scan and mirrored on the rows scanned right to left.
+ *
+ * ```
+ * # Floyd-Steinberg
+ * divisor 16
+ * - X 7
+ * 3 5 1
+ * ```
+ *
+ * The weights are converted once to doubles and to FIXED_WEIGHT_BITS
+ * fixed-point values, and only the non-zero taps are stored.
+ *
+ * @param filename Path to the kernel file.
+ * @return CUSTOM_KERNEL The taps of the kernel.
+ * @throws std::invalid_argument with the file and line if the file cannot
+ *         be read, reaches more than KERNEL_MAX_ROWS rows below the pixel,
+ *         has no taps, numerators or their sum above 65535, or weights
+ *         adding up to more than 1, also after rounding to fixed point.
  */
-VECTOR_DOUBLE_2D fliplr(VECTOR_DOUBLE_2D kernel);
+CUSTOM_KERNEL load_kernel(const std::string &filename);
 
 /**
  * @brief Performs error diffusion on the provided image.
  * 
- * @param image Image to be processed.
+ * @param image Image to be processed. Pass an rvalue (e.g.
+ *              `std::move(image)`) to avoid copying the input.
  * @param kernel_type Type of diffusion kernel to be used.
  * @param isMBVQ Flag to determine if MBVQ technique is used.
  * @param threshold Threshold for the error diffusion.
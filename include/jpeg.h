@@ -0,0 +1,254 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include "Image.h"
+#include <csetjmp>
+#include <cstddef>
+#include <cstdio>
+#include <jpeglib.h>
+#include <string>
+#include <vector>
+
+/**
+ * @struct JPEG_ERROR_MGR
+ * @brief libjpeg error handler that jumps back to the reader or writer
+ * instead of exiting the process.
+ *
+ * Exceptions must not unwind through the C frames of libjpeg, so its
+ * error_exit stores the message and longjmps to the setjmp of the entry
+ * point that called into libjpeg, which aborts and throws from there.
+ */
+struct JPEG_ERROR_MGR {
+  struct jpeg_error_mgr mgr;     /**< libjpeg's handler, must come first. */
+  jmp_buf jump;                  /**< Entry point of the running call. */
+  char message[JMSG_LENGTH_MAX]; /**< Message of the last error. */
+};
+
+/**
+ * @class JpegReader
+ * @brief Decodes a JPG file or buffer scanline by scanline into the rows of
+ * an Image.
+ *
+ * The reader only keeps libjpeg's own state, so images of any height can be
+ * decoded in pieces into a small Image used as a row buffer. A reader can be
+ * opened again after close() to decode further files with the same state.
+ * The file name `-` reads the standard input. libjpeg errors are thrown as
+ * std::runtime_error.
+ */
+class JpegReader {
+private:
+  struct jpeg_decompress_struct _cinfo; /**< libjpeg decoder state. */
+  JPEG_ERROR_MGR _jerr;                 /**< libjpeg error handler. */
+  struct jpeg_source_mgr *_file_src;    /**< Source of files, once created. */
+  struct jpeg_source_mgr *_memory_src;  /**< Source of buffers, once created. */
+  FILE *_file;                          /**< Opened input file. */
+  bool _started;                        /**< Whether decompression started. */
+  bool _luma;                           /**< Whether color is decoded as luma. */
+  std::vector<BYTE> _scratch;           /**< Rows for PLANAR destinations. */
+
+  /**
+   * @brief Reads the header from the source and starts decompression.
+   */
+  void _start(uint scale, bool fast_dct, bool gray);
+
+  /**
+   * @brief Aborts decoding after a libjpeg error, closes the file and
+   * throws the error. Called where the setjmp of an entry point returns.
+   * @throws std::runtime_error with the message of libjpeg.
+   */
+  [[noreturn]] void _fail();
+
+public:
+  /**
+   * @brief Default constructor.
+   */
+  JpegReader();
+
+  /**
+   * @brief Destructor, releases the decoder and closes the file.
+   */
+  ~JpegReader();
+
+  JpegReader(const JpegReader &) = delete;
+  JpegReader &operator=(const JpegReader &) = delete;
+
+  /**
+   * @brief Opens a JPG file and reads its header.
+   *
+   * With a scale of 2, 4 or 8 libjpeg decodes the image directly at that
+   * fraction of its size by dropping DCT coefficients, which saves the full
+   * size IDCT and buffers. The fast integer IDCT is quicker and slightly
+   * less accurate than the default one.
+   *
+   * With gray, a YCbCr image is decoded as one channel from its luma only,
+   * skipping the chroma and the color conversion, and mapped to the values
+   * of Image::rgb_2_gray().
+   *
+   * @param filename Path to the JPG image.
+   * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+   * @param fast_dct Use the fast integer IDCT.
+   * @param gray Decode color images as grayscale.
+   * @return bool False if the file could not be opened.
+   * @throws std::invalid_argument if scale is not supported.
+   */
+  bool open(const std::string &filename, uint scale = 1,
+            bool fast_dct = false, bool gray = false);
+
+  /**
+   * @brief Opens a JPG held in memory, e.g. a memory-mapped file, and reads
+   * its header. The buffer is not copied and has to outlive the decoding.
+   * @param data The JPG data.
+   * @param size Size of the JPG data in bytes.
+   * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+   * @param fast_dct Use the fast integer IDCT.
+   * @param gray Decode color images as grayscale.
+   * @throws std::invalid_argument if scale is not supported.
+   */
+  void open(const BYTE *data, size_t size, uint scale = 1,
+            bool fast_dct = false, bool gray = false);
+
+  /**
+   * @brief Returns the width of the decoded image.
+   */
+  uint width() const;
+
+  /**
+   * @brief Returns the height of the decoded image.
+   */
+  uint height() const;
+
+  /**
+   * @brief Returns the number of channels of the decoded image.
+   */
+  uint channels() const;
+
+  /**
+   * @brief Returns the index of the next row to be decoded.
+   */
+  uint scanline() const;
+
+  /**
+   * @brief Decodes the next rows into rows [first, first + rows) of an image.
+   *
+   * INTERLEAVED images are decoded in place, PLANAR images through a small
+   * scratch buffer.
+   *
+   * @param image Destination with the width and channels of the JPG.
+   * @param first First destination row.
+   * @param rows Number of rows to decode.
+   * @return uint Number of rows decoded, less than rows at the end.
+   */
+  uint read(Image &image, uint first, uint rows);
+
+  /**
+   * @brief Finishes decoding and closes the file. An image that was not
+   * decoded to the end, e.g. after an error, is aborted.
+   */
+  void close();
+};
+
+/**
+ * @class JpegWriter
+ * @brief Encodes the rows of an Image scanline by scanline into a JPG file
+ * or buffer.
+ *
+ * Single channel images are written as grayscale JPGs, or as RGB with the
+ * channel replicated when the writer was opened for three channels. Like
+ * JpegReader, a writer can be reused after close(), writes the standard
+ * output for the file name `-` and throws libjpeg errors as
+ * std::runtime_error.
+ */
+class JpegWriter {
+private:
+  struct jpeg_compress_struct _cinfo; /**< libjpeg encoder state. */
+  JPEG_ERROR_MGR _jerr;               /**< libjpeg error handler. */
+  struct jpeg_destination_mgr *_file_dest; /**< Destination of files. */
+  struct jpeg_destination_mgr _buffer_dest; /**< Destination of buffers. */
+  std::vector<BYTE> *_buffer;         /**< Opened output buffer. */
+  FILE *_file;                        /**< Opened output file. */
+  bool _started;                      /**< Whether compression started. */
+  std::vector<BYTE> _scratch;         /**< Rows converted to the output. */
+
+  /**
+   * @brief Sets the parameters of the JPG and starts compression.
+   */
+  void _start(uint width, uint height, int quality, uint channels,
+              uint restart_rows);
+
+  /**
+   * @brief Aborts encoding after a libjpeg error, empties the buffer,
+   * closes the file and throws the error. Called where the setjmp of an
+   * entry point returns.
+   * @throws std::runtime_error with the message of libjpeg.
+   */
+  [[noreturn]] void _fail();
+
+public:
+  /**
+   * @brief Default constructor.
+   */
+  JpegWriter();
+
+  /**
+   * @brief Destructor, releases the encoder and closes the file.
+   */
+  ~JpegWriter();
+
+  JpegWriter(const JpegWriter &) = delete;
+  JpegWriter &operator=(const JpegWriter &) = delete;
+
+  /**
+   * @brief Creates a JPG file and starts compression.
+   * @param filename Path to save the JPG image.
+   * @param width Image width.
+   * @param height Image height.
+   * @param quality Quality of the saved JPG image.
+   * @param channels Channels of the JPG: 1 for grayscale or 3 for RGB.
+   * @param restart_rows Rows of MCUs between restart markers, 0 for none.
+   * @return bool False if the file could not be created.
+   */
+  bool open(const std::string &filename, uint width, uint height,
+            int quality = 75, uint channels = 3, uint restart_rows = 0);
+
+  /**
+   * @brief Starts compression into a buffer.
+   *
+   * The buffer grows as the JPG is encoded and holds exactly the JPG after
+   * close(), or nothing if the image was aborted. Its capacity is reused,
+   * so encoding many images into the same buffer does not reallocate.
+   *
+   * @param buffer Buffer receiving the JPG, has to outlive the encoding.
+   * @param width Image width.
+   * @param height Image height.
+   * @param quality Quality of the JPG image.
+   * @param channels Channels of the JPG: 1 for grayscale or 3 for RGB.
+   * @param restart_rows Rows of MCUs between restart markers, 0 for none.
+   */
+  void open(std::vector<BYTE> &buffer, uint width, uint height,
+            int quality = 75, uint channels = 3, uint restart_rows = 0);
+
+  /**
+   * @brief Returns the index of the next row to be encoded.
+   */
+  uint scanline() const;
+
+  /**
+   * @brief Encodes rows [first, first + rows) of an image as the next rows.
+   *
+   * INTERLEAVED RGB images are handed to libjpeg straight from their rows,
+   * everything else goes through a small scratch buffer.
+   *
+   * @param image Source with the width of the JPG.
+   * @param first First source row.
+   * @param rows Number of rows to encode.
+   */
+  void write(const Image &image, uint first, uint rows);
+
+  /**
+   * @brief Finishes compression and closes the file or buffer. An image
+   * that was not encoded to the end, e.g. after an error, is aborted.
+   */
+  void close();
+};
+
+#endif
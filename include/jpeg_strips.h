@@ -0,0 +1,76 @@
+#ifndef JPEG_STRIPS_H
+#define JPEG_STRIPS_H
+
+#include "Image.h"
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief Rows of MCUs encoded by one task of write_jpg_strips().
+ *
+ * Every row of MCUs is a restart interval and the restart markers cycle
+ * through RST0 to RST7, so with a multiple of 8 the markers of every strip
+ * are already numbered as in the stitched JPG.
+ */
+const uint JPEG_STRIP_MCU_ROWS = 8;
+
+/**
+ * @brief Encodes an image into a baseline JPG in horizontal strips, in
+ * parallel.
+ *
+ * The strips are JPEG_STRIP_MCU_ROWS rows of MCUs high and are encoded
+ * independently with a restart marker after every row of MCUs. A restart
+ * resets the DC prediction, so the entropy coded data of the strips is
+ * joined with a restart marker into a single scan. The result is a standard
+ * baseline JPG with a restart interval, decoded like any other: its pixels
+ * are those of a JPG encoded without restarts, and its bytes do not depend
+ * on the number of threads.
+ *
+ * @param image The image, with 1 or 3 channels.
+ * @param jpg Receives the JPG, its capacity is reused.
+ * @param quality Quality of the JPG image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void write_jpg_strips(const Image &image, std::vector<BYTE> &jpg, int quality,
+                      uint threads);
+
+/**
+ * @brief Encodes an image like write_jpg_strips() and writes the JPG to a
+ * file as the strips are stitched, without holding it in memory twice.
+ * @param image The image, with 1 or 3 channels.
+ * @param file The opened output file.
+ * @param quality Quality of the JPG image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @return bool False if writing to the file failed.
+ */
+bool write_jpg_strips(const Image &image, FILE *file, int quality,
+                      uint threads);
+
+/**
+ * @brief Decodes a JPG with restart markers in horizontal strips, in
+ * parallel.
+ *
+ * The restart markers split the scan into intervals that are decoded
+ * independently. Strips of whole rows of MCUs are rebuilt into standalone
+ * JPGs from the header and their intervals, with one more aligned row of
+ * MCUs above and below that is decoded and dropped, so that chroma
+ * upsampling sees the same neighbors as in a sequential decode and the
+ * pixels are identical.
+ *
+ * @param data The JPG data.
+ * @param size Size of the JPG data in bytes.
+ * @param image Destination, already sized for the decoded JPG.
+ * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @return bool False, without decoding, if the JPG cannot be split: it has
+ *         no restart markers, is not a single baseline scan, its intervals
+ *         do not start on rows of MCUs often enough, or there is one
+ *         thread.
+ */
+bool read_jpg_strips(const BYTE *data, size_t size, Image &image, uint scale,
+                     bool fast_dct, bool gray, uint threads);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+/**
+ * @typedef uint
+ * @brief Alias for unsigned integer type.
+ */
+typedef unsigned int uint;
+
+/**
+ * @brief Returns the number of threads to use for a requested count,
+ * 0 meaning one per hardware thread.
+ * @param threads Requested number of threads.
+ */
+uint thread_count(uint threads);
+
+/**
+ * @brief Runs task(0) ... task(tasks - 1) on up to `threads` threads.
+ *
+ * The calling thread takes part in the work; tasks are handed out in order
+ * from a shared counter. Returns once every task has finished; if a task
+ * throws, the remaining tasks are skipped and the first exception is
+ * rethrown.
+ *
+ * @param tasks Number of tasks.
+ * @param threads Maximum number of threads, including the calling one.
+ * @param task Function called with the index of each task.
+ */
+void parallel_for(uint tasks, uint threads,
+                  const std::function<void(uint)> &task);
+
+#endif
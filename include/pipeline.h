@@ -0,0 +1,94 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "BitImage.h"
+#include "Image.h"
+#include "diffusion_kernel.h"
+#include "dithering.h"
+#include <memory>
+#include <string>
+
+/**
+ * @enum OPERATION
+ * @brief Defines the halftoning operations of the pipeline.
+ */
+enum OPERATION {
+  DITHERING = 1,        ///< Ordered dithering with a Bayer matrix.
+  ERROR_DIFFUSION = 2   ///< Error diffusion with a diffusion kernel.
+};
+
+/**
+ * @struct PIPELINE
+ * @brief Describes the stages an image goes through between decode and encode.
+ */
+struct PIPELINE {
+  uint scale = 1;                            ///< Decode at 1/scale of the JPG size.
+  bool fast_dct = false;                     ///< Decode with the fast integer IDCT.
+  OPERATION op = DITHERING;                  ///< Halftoning operation.
+  bool bw = false;                           ///< Convert to black and white first.
+  uint size = 8;                             ///< Dithering matrix dimension.
+  std::shared_ptr<const mCRATE> mask;        ///< Blue-noise thresholds, Bayer if null.
+  DIFFUSION_KERNEL kernel = JARVIS_JUDICE_NINKE; ///< Error diffusion kernel.
+  CUSTOM_KERNEL custom;                      ///< Taps of a CUSTOM kernel.
+  bool auto_threshold = false;               ///< Pick the threshold with Otsu's method.
+  double threshold = 127.;                   ///< Error diffusion threshold.
+  bool isMBVQ = false;                       ///< Use MBVQ technique for error diffusion.
+  bool fixed = false;                        ///< Use fixed-point error diffusion.
+  int brightness = 0;                        ///< Value added to every sample.
+  int contrast = 1;                          ///< Factor every sample is multiplied with.
+  uint threads = 1;                          ///< Number of threads, 0 for all cores.
+};
+
+/**
+ * @brief Applies the contrast and brightness stages in place.
+ *
+ * @param image The image to be adjusted.
+ * @param pipeline The stages to apply.
+ */
+void adjust(Image &image, const PIPELINE &pipeline);
+
+/**
+ * @brief Runs all stages of the pipeline on an image in memory.
+ *
+ * @param image The image to be processed, replaced by the result.
+ * @param pipeline The stages to apply.
+ */
+void process(Image &image, const PIPELINE &pipeline);
+
+/**
+ * @brief Runs all stages of the pipeline on an image in memory and returns
+ * the halftone as bits.
+ *
+ * Ordered dithering writes the bits directly with dither(), error diffusion
+ * runs in place and is packed afterwards. Either way the result takes 1/8
+ * of the memory of the image, e.g. for a PBM or PAM output.
+ *
+ * @param image The image to be processed, used as working buffer and left
+ *              in an unspecified state.
+ * @param bits Receives the halftone, its buffer is reused.
+ * @param pipeline The stages to apply.
+ */
+void process(Image &image, BitImage &bits, const PIPELINE &pipeline);
+
+/**
+ * @brief Runs all stages of the pipeline while streaming rows from the input
+ * JPG to the output image.
+ *
+ * Only a fixed number of rows is held in memory: the decoded batch and, for
+ * error diffusion, as many rows of error state as the kernel is tall. The
+ * memory therefore does not depend on the image height, except for a color
+ * PBM written to a pipe, whose packed G and B images are kept until the end.
+ * The automatic threshold needs the whole image and is not supported. The
+ * output is written through partial_output(), so a failed run leaves a
+ * previous output file as it was.
+ *
+ * @param input Path to the input JPG image.
+ * @param output Path to save the output image, a PBM or PAM for the
+ *               extensions of output_format() and a JPG otherwise.
+ * @param pipeline The stages to apply.
+ * @return bool False if the input or output could not be opened.
+ */
+bool process_stream(const std::string &input, const std::string &output,
+                    const PIPELINE &pipeline);
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+
+/**
+ * @typedef BYTE
+ * @brief Defines a type representing a byte.
+ */
+typedef unsigned char BYTE;
+
+/**
+ * @brief Saturating element-wise addition, dst = min(a + b, 255).
+ *
+ * The kernels in this header are vectorized with AVX2 or SSE2 depending on
+ * the instruction sets enabled at compile time, with a scalar fallback.
+ * Source and destination may alias.
+ *
+ * @param a First operand.
+ * @param b Second operand.
+ * @param dst Destination.
+ * @param n Number of elements.
+ */
+void add_saturate(const BYTE *a, const BYTE *b, BYTE *dst, size_t n);
+
+/**
+ * @brief Saturating element-wise subtraction, dst = max(a - b, 0).
+ * @param a First operand.
+ * @param b Second operand.
+ * @param dst Destination.
+ * @param n Number of elements.
+ */
+void sub_saturate(const BYTE *a, const BYTE *b, BYTE *dst, size_t n);
+
+/**
+ * @brief Adds a constant with saturation, dst = clamp(src + value, 0, 255).
+ * @param src Source.
+ * @param value Constant to add, may be negative.
+ * @param dst Destination.
+ * @param n Number of elements.
+ */
+void add_scalar_saturate(const BYTE *src, int value, BYTE *dst, size_t n);
+
+/**
+ * @brief Multiplies by a constant with saturation,
+ * dst = clamp(src * factor, 0, 255).
+ * @param src Source.
+ * @param factor Constant to multiply with, may be negative.
+ * @param dst Destination.
+ * @param n Number of elements.
+ */
+void scale_saturate(const BYTE *src, int factor, BYTE *dst, size_t n);
+
+/**
+ * @brief Finds the minimum and maximum of a range in one pass.
+ * @param src Source.
+ * @param n Number of elements.
+ * @param min Updated with the minimum of its value and the range.
+ * @param max Updated with the maximum of its value and the range.
+ */
+void min_max(const BYTE *src, size_t n, BYTE &min, BYTE &max);
+
+/**
+ * @brief Converts interleaved RGB samples to grayscale,
+ * Y = (257 * R + 504 * G + 98 * B) / 1000 + 16 in exact integer arithmetic.
+ *
+ * This is the fixed-point form of Y = 0.257 * R + 0.504 * G + 0.098 * B + 16.
+ * It equals the truncated double precision result except for 366 of the
+ * 2^24 inputs, where the exact result is an integer and the double
+ * evaluation lands just below it; there the double result is 1 lower.
+ * Vectorized with SSSE3 (16 pixels) or AVX2 (32 pixels) per iteration.
+ *
+ * @param rgb Interleaved RGB source, 3 * n samples.
+ * @param gray Destination, n samples.
+ * @param n Number of pixels.
+ */
+void rgb_to_gray(const BYTE *rgb, BYTE *gray, size_t n);
+
+/**
+ * @brief Converts separate R, G and B planes to grayscale with the same
+ * formula as rgb_to_gray().
+ * @param R Red samples.
+ * @param G Green samples.
+ * @param B Blue samples.
+ * @param gray Destination.
+ * @param n Number of pixels.
+ */
+void planes_to_gray(const BYTE *R, const BYTE *G, const BYTE *B, BYTE *gray,
+                    size_t n);
+
+/**
+ * @brief Converts the full range luma of a JPG (JFIF Y) to the grayscale of
+ * rgb_to_gray(), which weights R, G and B like the luma in a smaller range.
+ * The result is exact for neutral pixels.
+ * @param luma Luma samples.
+ * @param gray Destination, may alias luma.
+ * @param n Number of pixels.
+ */
+void luma_to_gray(const BYTE *luma, BYTE *gray, size_t n);
+
+/**
+ * @brief Binarizes a range against per-element thresholds,
+ * dst = src > thresholds ? 255 : 0.
+ * @param src Source.
+ * @param thresholds Threshold of every element.
+ * @param dst Destination, may alias src.
+ * @param n Number of elements.
+ */
+void threshold_row(const BYTE *src, const BYTE *thresholds, BYTE *dst,
+                   size_t n);
+
+/**
+ * @brief Packs a range of bilevel samples into bits, eight per byte with the
+ * first sample in the most significant bit. Like in PBM, a bit is set for a
+ * dark sample (below 128) and the bits past n in the last byte are zero.
+ * @param src Source samples.
+ * @param dst Destination of (n + 7) / 8 bytes.
+ * @param n Number of samples.
+ */
+void pack_bits(const BYTE *src, BYTE *dst, size_t n);
+
+/**
+ * @brief Packs interleaved RGB samples into one bit plane per channel, with
+ * the bits of pack_bits().
+ * @param rgb Source, 3 * n samples.
+ * @param R Destination of the red bits, (n + 7) / 8 bytes.
+ * @param G Destination of the green bits, (n + 7) / 8 bytes.
+ * @param B Destination of the blue bits, (n + 7) / 8 bytes.
+ * @param n Number of pixels.
+ */
+void pack_rgb_bits(const BYTE *rgb, BYTE *R, BYTE *G, BYTE *B, size_t n);
+
+/**
+ * @brief Binarizes a range against per-element thresholds into bits like
+ * threshold_row() followed by pack_bits(): a bit is set where
+ * src <= thresholds, i.e. where threshold_row() writes 0.
+ * @param src Source.
+ * @param thresholds Threshold of every element.
+ * @param dst Destination of (n + 7) / 8 bytes.
+ * @param n Number of elements.
+ */
+void threshold_bits(const BYTE *src, const BYTE *thresholds, BYTE *dst,
+                    size_t n);
+
+/**
+ * @brief Expands bits of pack_bits() into bilevel samples,
+ * dst = bit ? 0 : 255.
+ * @param src Source of (n + 7) / 8 bytes.
+ * @param dst Destination samples.
+ * @param n Number of samples.
+ */
+void unpack_bits(const BYTE *src, BYTE *dst, size_t n);
+
+/**
+ * @brief Splits the bits of n interleaved RGB samples, as packed by
+ * pack_bits() from an RGB row, into one bit plane per channel.
+ * @param bits Source of (3 * n + 7) / 8 bytes.
+ * @param R Destination of the red bits, (n + 7) / 8 bytes.
+ * @param G Destination of the green bits, (n + 7) / 8 bytes.
+ * @param B Destination of the blue bits, (n + 7) / 8 bytes.
+ * @param n Number of pixels.
+ */
+void split_rgb_bits(const BYTE *bits, BYTE *R, BYTE *G, BYTE *B, size_t n);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "Image.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @typedef HISTOGRAM
+ * @brief Represents the number of occurrences of each of the 256 sample values.
+ */
+typedef std::array<uint64_t, 256> HISTOGRAM;
+
+/**
+ * @struct STATISTICS
+ * @brief Holds the per-channel statistics of an image.
+ */
+struct STATISTICS {
+  std::vector<BYTE> min;             ///< Minimum sample value of each channel.
+  std::vector<BYTE> max;             ///< Maximum sample value of each channel.
+  std::vector<double> mean;          ///< Mean sample value of each channel.
+  std::vector<HISTOGRAM> histogram;  ///< Histogram of each channel.
+
+  /**
+   * @brief Returns the histogram of all channels combined.
+   */
+  HISTOGRAM combined() const;
+};
+
+/**
+ * @brief Computes min, max, mean and histogram of every channel of an image.
+ *
+ * The image is read exactly once; min, max and mean are derived from the
+ * histograms, which are accumulated in several interleaved sub-tables so that
+ * consecutive equal samples do not serialize on the same counter.
+ *
+ * The histogram is deliberately scalar. Every sample increments a counter
+ * chosen by its value, which AVX2 cannot scatter, and counting without
+ * scatters compares every vector against all 256 values. The scalar loop
+ * runs at about 1 GB/s, roughly 15 times the cost of a plain read of the
+ * image with min_max(), which is fine for its one use, `threshold=auto`.
+ *
+ * @param image The image to be analysed.
+ * @return STATISTICS The per-channel statistics.
+ */
+STATISTICS statistics(const Image &image);
+
+/**
+ * @brief Finds a threshold that separates a histogram into two classes
+ * using Otsu's method (maximum between-class variance).
+ *
+ * @param histogram The histogram to be split.
+ * @return BYTE The threshold; samples greater than or equal to it belong to
+ * the bright class. 127 if the histogram cannot be split.
+ */
+BYTE otsu_threshold(const HISTOGRAM &histogram);
+
+#endif
@@ -0,0 +1,181 @@
+#include "BitImage.h"
+#include "Image.h"
+#include "simd.h"
+#include <assert.h>
+
+typedef unsigned int uint;
+
+/**
+ * @brief Default constructor.
+ */
+BitImage::BitImage()
+    : _width(0), _height(0), _channels(0), _layout(INTERLEAVED), _stride(0),
+      _plane(0) {}
+
+/**
+ * @brief Parameterized constructor to initialize an image with given
+ * dimensions, all samples 255.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of color channels.
+ * @param layout Arrangement of the channels in memory.
+ */
+BitImage::BitImage(uint width, uint height, uint channels, LAYOUT layout)
+    : BitImage() {
+  this->resize(width, height, channels, layout);
+}
+
+/**
+ * @brief Packs an image, a sample below 128 becomes 0 and any other 255.
+ * @param image The image.
+ */
+BitImage::BitImage(const Image &image) : BitImage() {
+  this->resize(image.width(), image.height(), image.channels(),
+               image.layout());
+  for (uint i = 0; i < this->_height; i++) {
+    this->pack_row(i, image, i);
+  }
+}
+
+/**
+ * @brief Sets the dimensions of the image, all samples 255.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of color channels.
+ * @param layout Arrangement of the channels in memory.
+ */
+void BitImage::resize(uint width, uint height, uint channels, LAYOUT layout) {
+  this->_width = width;
+  this->_height = height;
+  this->_channels = channels;
+  this->_layout = layout;
+  // pad every row to the alignment so that all rows start aligned, the
+  // padding bits stay zero
+  const size_t bytes = (this->span() + 7) / 8;
+  this->_stride =
+      (bytes + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+  this->_plane = layout == PLANAR ? this->_stride * height : 0;
+  const size_t planes = layout == PLANAR ? channels : 1;
+  this->_buffer.assign(this->_stride * height * planes, 0);
+}
+
+/**
+ * @brief Returns the width of the image.
+ */
+uint BitImage::width() const { return this->_width; }
+
+/**
+ * @brief Returns the height of the image.
+ */
+uint BitImage::height() const { return this->_height; }
+
+/**
+ * @brief Returns the number of channels of the image.
+ */
+uint BitImage::channels() const { return this->_channels; }
+
+/**
+ * @brief Returns the arrangement of the channels in memory.
+ */
+LAYOUT BitImage::layout() const { return this->_layout; }
+
+/**
+ * @brief Returns the distance in bytes between the starts of two rows.
+ */
+size_t BitImage::stride() const { return this->_stride; }
+
+/**
+ * @brief Returns the number of samples in a row of a single span.
+ */
+size_t BitImage::span() const {
+  return this->_layout == PLANAR ? (size_t)this->_width
+                                 : (size_t)this->_width * this->_channels;
+}
+
+/**
+ * @brief Returns a pointer to the first byte of row i.
+ * @param i Row index.
+ * @param k Channel index, 0 for INTERLEAVED images.
+ */
+BYTE *BitImage::row(uint i, uint k) {
+  return this->_buffer.data() + i * this->_stride + k * this->_plane;
+}
+
+/**
+ * @brief Returns a pointer to the first byte of row i.
+ * @param i Row index.
+ * @param k Channel index, 0 for INTERLEAVED images.
+ */
+const BYTE *BitImage::row(uint i, uint k) const {
+  return this->_buffer.data() + i * this->_stride + k * this->_plane;
+}
+
+/**
+ * @brief Gets the sample at a specific location, 0 or 255.
+ * @param i Row index.
+ * @param j Column index.
+ * @param k Channel index.
+ */
+BYTE BitImage::get(uint i, uint j, uint k) const {
+  const bool planar = this->_layout == PLANAR;
+  const size_t n = planar ? j : (size_t)j * this->_channels + k;
+  return (this->row(i, planar ? k : 0)[n / 8] >> (7 - n % 8)) & 1 ? 0 : 255;
+}
+
+/**
+ * @brief Sets the sample at a specific location.
+ * @param i Row index.
+ * @param j Column index.
+ * @param k Channel index.
+ * @param val Value to be set, 0 below 128 and 255 otherwise.
+ */
+void BitImage::set(uint i, uint j, uint k, BYTE val) {
+  const bool planar = this->_layout == PLANAR;
+  const size_t n = planar ? j : (size_t)j * this->_channels + k;
+  BYTE &bits = this->row(i, planar ? k : 0)[n / 8];
+  const BYTE bit = 0x80 >> (n % 8);
+  bits = val < 128 ? bits | bit : bits & ~bit;
+}
+
+/**
+ * @brief Packs a row of an image with the same shape into row i.
+ * @param i Row index.
+ * @param image The image.
+ * @param row Row index in image.
+ */
+void BitImage::pack_row(uint i, const Image &image, uint row) {
+  assert(image.width() == this->_width &&
+         image.channels() == this->_channels &&
+         image.layout() == this->_layout);
+  const uint planes = this->_layout == PLANAR ? this->_channels : 1;
+  for (uint k = 0; k < planes; k++) {
+    pack_bits(image.row(row, k), this->row(i, k), this->span());
+  }
+}
+
+/**
+ * @brief Expands row i into a row of an image with the same shape.
+ * @param i Row index.
+ * @param image The image.
+ * @param row Row index in image.
+ */
+void BitImage::unpack_row(uint i, Image &image, uint row) const {
+  assert(image.width() == this->_width &&
+         image.channels() == this->_channels &&
+         image.layout() == this->_layout);
+  const uint planes = this->_layout == PLANAR ? this->_channels : 1;
+  for (uint k = 0; k < planes; k++) {
+    unpack_bits(this->row(i, k), image.row(row, k), this->span());
+  }
+}
+
+/**
+ * @brief Expands the image to 8 bits per sample, with the same layout.
+ */
+Image BitImage::toImage() const {
+  Image image(this->_width, this->_height, this->_channels, this->_layout);
+  for (uint i = 0; i < this->_height; i++) {
+    this->unpack_row(i, image, i);
+  }
+  return image;
+}
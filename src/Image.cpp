@@ -1,137 +1,216 @@
 #include "Image.h"
+#include "jpeg.h"
+#include "jpeg_strips.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
 #include <assert.h>
 #include <cstdio>
-#include <jpeglib.h>
+#include <fcntl.h>
+#include <stdexcept>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 typedef unsigned int uint;
 
-/** 
+#ifdef IMAGE_COUNT_COPIES
+std::atomic<size_t> Image::copies(0);
+#endif
+
+/**
+ * @brief Computes the stride, plane and step for the current dimensions
+ * and allocates a zero initialized buffer.
+ */
+void Image::_allocate() {
+  const size_t span = this->_layout == PLANAR
+                          ? (size_t)this->_width
+                          : (size_t)this->_width * this->_channels;
+  // pad every row to the alignment so that all rows start aligned
+  this->_stride =
+      (span + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+  if (this->_layout == PLANAR) {
+    this->_plane = this->_stride * this->_height;
+    this->_step = 1;
+  } else {
+    this->_plane = 1;
+    this->_step = this->_channels;
+  }
+  const size_t planes = this->_layout == PLANAR ? this->_channels : 1;
+  this->_buffer.assign(this->_stride * this->_height * planes, 0);
+}
+
+/**
  * @brief Default constructor.
  */
-Image::Image(uint width, uint height, uint channels) {
+Image::Image()
+    : _width(0), _height(0), _channels(0), _layout(INTERLEAVED), _stride(0),
+      _plane(1), _step(0) {}
+
+/**
+ * @brief Parameterized constructor to initialize image with given dimensions.
+ */
+Image::Image(uint width, uint height, uint channels, LAYOUT layout) {
   this->_width = width;
   this->_height = height;
   this->_channels = channels;
-  this->_crate.resize(height);
-  for (int i = 0; i < height; i++) {
-    this->_crate[i].resize(width);
-    for (int j = 0; j < width; j++) {
-      this->_crate[i][j].resize(channels);
-    }
-  }
+  this->_layout = layout;
+  this->_allocate();
 }
 
 /**
- * @brief Creates a new image with the same dimensions but without data.
+ * @brief Copy constructor, duplicates the image buffer.
  */
-Image Image::like() {
-  Image new_image = Image(this->_width, this->_height, this->_channels);
-  return new_image;
+Image::Image(const Image &other)
+    : _width(other._width), _height(other._height),
+      _channels(other._channels), _layout(other._layout),
+      _stride(other._stride), _plane(other._plane), _step(other._step),
+      _buffer(other._buffer) {
+#ifdef IMAGE_COUNT_COPIES
+  Image::copies++;
+#endif
+}
+
+/**
+ * @brief Move constructor, takes over the image buffer and leaves
+ * the source empty.
+ */
+Image::Image(Image &&other) noexcept
+    : _width(other._width), _height(other._height),
+      _channels(other._channels), _layout(other._layout),
+      _stride(other._stride), _plane(other._plane), _step(other._step),
+      _buffer(std::move(other._buffer)) {
+  other._width = other._height = other._channels = 0;
+  other._layout = INTERLEAVED;
+  other._stride = other._step = 0;
+  other._plane = 1;
+  other._buffer.clear();
 }
 
 /**
- * @brief Assignment operator.
+ * @brief Copy assignment operator, duplicates the image buffer.
  */
 Image &Image::operator=(const Image &rhs) {
-  this->_width = rhs._width;
-  this->_height = rhs._height;
-  this->_channels = rhs._channels;
-  this->_crate = rhs._crate;
+  if (this != &rhs) {
+    Image copy(rhs);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+/**
+ * @brief Move assignment operator, takes over the image buffer and leaves
+ * the source empty.
+ */
+Image &Image::operator=(Image &&rhs) noexcept {
+  if (this != &rhs) {
+    this->_width = rhs._width;
+    this->_height = rhs._height;
+    this->_channels = rhs._channels;
+    this->_layout = rhs._layout;
+    this->_stride = rhs._stride;
+    this->_plane = rhs._plane;
+    this->_step = rhs._step;
+    this->_buffer = std::move(rhs._buffer);
+    rhs._width = rhs._height = rhs._channels = 0;
+    rhs._layout = INTERLEAVED;
+    rhs._stride = rhs._step = 0;
+    rhs._plane = 1;
+    rhs._buffer.clear();
+  }
   return *this;
 }
 
 /**
- * @brief Addition operator to add two images.
+ * @brief Creates a new image with the same dimensions but without data.
+ */
+Image Image::like() const {
+  Image new_image =
+      Image(this->_width, this->_height, this->_channels, this->_layout);
+  return new_image;
+}
+
+/**
+ * @brief Addition operator to add two images, saturating at 255.
  */
 Image Image::operator+(const Image &rhs) {
   assert(this->_width == rhs._width && this->_height == rhs._height &&
-         this->_channels == rhs._channels);
-  Image result;
-  result._width = this->_width;
-  result._height = this->_height;
-  result._channels = this->_channels;
-  result._crate.resize(this->_height);
-  for (int i = 0; i < this->_height; i++) {
-    result._crate[i].resize(this->_width);
-    for (int j = 0; j < this->_width; j++) {
-      result._crate[i][j].resize(this->_channels);
-      for (int k = 0; k < this->_channels; k++) {
-        result._crate[i][j][k] = this->_crate[i][j][k] + rhs._crate[i][j][k];
-      }
-    }
-  }
+         this->_channels == rhs._channels && this->_layout == rhs._layout);
+  Image result = this->like();
+  add_saturate(this->data(), rhs.data(), result.data(), this->_buffer.size());
+  return result;
+}
+
+/**
+ * @brief Subtraction operator to subtract two images, saturating at 0.
+ */
+Image Image::operator-(const Image &rhs) {
+  assert(this->_width == rhs._width && this->_height == rhs._height &&
+         this->_channels == rhs._channels && this->_layout == rhs._layout);
+  Image result = this->like();
+  sub_saturate(this->data(), rhs.data(), result.data(), this->_buffer.size());
   return result;
 }
 
 /**
- * @brief Addition operator to add a constant value to an image.
+ * @brief Addition operator to add a constant value to an image, saturating
+ * at 0 and 255.
  */
 Image Image::operator+(const int &rhs) {
-  Image result;
-  result._width = this->_width;
-  result._height = this->_height;
-  result._channels = this->_channels;
-  result._crate.resize(this->_height);
-  for (int i = 0; i < this->_height; i++) {
-    result._crate[i].resize(this->_width);
-    for (int j = 0; j < this->_width; j++) {
-      result._crate[i][j].resize(this->_channels);
-      for (int k = 0; k < this->_channels; k++) {
-        result._crate[i][j][k] += this->_crate[i][j][k] + rhs;
-      }
-    }
-  }
+  Image result = this->like();
+  add_scalar_saturate(this->data(), rhs, result.data(), this->_buffer.size());
   return result;
 }
 
 /**
- * @brief Addition assignment operator.
+ * @brief Addition assignment operator, saturating at 0 and 255.
  */
-Image Image::operator+=(const int &rhs) { return *this = *this + rhs; }
+Image &Image::operator+=(const int &rhs) {
+  add_scalar_saturate(this->data(), rhs, this->data(), this->_buffer.size());
+  return *this;
+}
 
 /**
- * @brief Subtraction operator to subtract two images.
+ * @brief Subtraction operator to subtract a constant value from an image,
+ * saturating at 0 and 255.
  */
-Image Image::operator-(const int &rhs) { return *this = *this + (-rhs); }
+Image Image::operator-(const int &rhs) { return *this + (-rhs); }
 
 /**
- * @brief Subtraction assignment operator.
+ * @brief Subtraction assignment operator, saturating at 0 and 255.
  */
-Image Image::operator-=(const int &rhs) { return *this = *this - rhs; }
+Image &Image::operator-=(const int &rhs) { return *this += -rhs; }
 
 /**
- * @brief Multiplication operator to multiply image with a constant.
+ * @brief Multiplication operator to multiply image with a constant,
+ * saturating at 0 and 255.
  */
 Image Image::operator*(const int &rhs) {
-  Image result;
-  result._width = this->_width;
-  result._height = this->_height;
-  result._channels = this->_channels;
-  result._crate.resize(this->_height);
-  for (int i = 0; i < this->_height; i++) {
-    result._crate[i].resize(this->_width);
-    for (int j = 0; j < this->_width; j++) {
-      result._crate[i][j].resize(this->_channels);
-      for (int k = 0; k < this->_channels; k++) {
-        result._crate[i][j][k] += this->_crate[i][j][k] * rhs;
-      }
-    }
-  }
+  Image result = this->like();
+  scale_saturate(this->data(), rhs, result.data(), this->_buffer.size());
   return result;
 }
 
+/**
+ * @brief Multiplication assignment operator, saturating at 0 and 255.
+ */
+Image &Image::operator*=(const int &rhs) {
+  scale_saturate(this->data(), rhs, this->data(), this->_buffer.size());
+  return *this;
+}
+
 /**
  * @brief Finds the minimum value in the image data.
  */
-int Image::min() {
-  BYTE res = 255;
-  for (int i = 0; i < this->_height; i++) {
-    for (int j = 0; j < this->_width; j++) {
-      for (int k = 0; k < this->_channels; k++) {
-        res = std::min(res, this->_crate[i][j][k]);
-      }
+int Image::min() const {
+  BYTE res = 255, unused = 0;
+  const uint planes = this->_layout == PLANAR ? this->_channels : 1;
+  for (uint i = 0; i < this->_height; i++) {
+    for (uint k = 0; k < planes; k++) {
+      min_max(this->row(i, k), this->span(), res, unused);
     }
   }
   return res;
@@ -140,13 +219,12 @@ int Image::min() {
 /**
  * @brief Finds the maximum value in the image data.
  */
-int Image::max() {
-  BYTE res = 0;
-  for (int i = 0; i < this->_height; i++) {
-    for (int j = 0; j < this->_width; j++) {
-      for (int k = 0; k < this->_channels; k++) {
-        res = std::max(res, this->_crate[i][j][k]);
-      }
+int Image::max() const {
+  BYTE res = 0, unused = 255;
+  const uint planes = this->_layout == PLANAR ? this->_channels : 1;
+  for (uint i = 0; i < this->_height; i++) {
+    for (uint k = 0; k < planes; k++) {
+      min_max(this->row(i, k), this->span(), unused, res);
     }
   }
   return res;
@@ -155,17 +233,69 @@ int Image::max() {
 /**
  * @brief Returns the width of the image.
  */
-uint Image::width() { return this->_width; }
+uint Image::width() const { return this->_width; }
 
 /**
  * @brief Returns the height of the image.
  */
-uint Image::height() { return this->_height; }
+uint Image::height() const { return this->_height; }
 
 /**
  * @brief Returns the number of channels of the image.
  */
-uint Image::channels() { return this->_channels; }
+uint Image::channels() const { return this->_channels; }
+
+/**
+ * @brief Returns the arrangement of the channels in memory.
+ */
+LAYOUT Image::layout() const { return this->_layout; }
+
+/**
+ * @brief Returns the distance in bytes between the starts of two rows.
+ */
+size_t Image::stride() const { return this->_stride; }
+
+/**
+ * @brief Returns the distance in bytes between two consecutive samples of
+ * the same channel within a row.
+ */
+size_t Image::step() const { return this->_step; }
+
+/**
+ * @brief Returns the number of samples in a row of a single span.
+ */
+size_t Image::span() const {
+  return this->_layout == PLANAR ? (size_t)this->_width
+                                 : (size_t)this->_width * this->_channels;
+}
+
+/**
+ * @brief Returns a pointer to the first sample of the buffer.
+ */
+BYTE *Image::data() { return this->_buffer.data(); }
+
+/**
+ * @brief Returns a pointer to the first sample of the buffer.
+ */
+const BYTE *Image::data() const { return this->_buffer.data(); }
+
+/**
+ * @brief Returns a pointer to the first sample of channel k in row i.
+ * @param i Row index.
+ * @param k Channel index.
+ */
+BYTE *Image::row(uint i, uint k) {
+  return this->_buffer.data() + i * this->_stride + k * this->_plane;
+}
+
+/**
+ * @brief Returns a pointer to the first sample of channel k in row i.
+ * @param i Row index.
+ * @param k Channel index.
+ */
+const BYTE *Image::row(uint i, uint k) const {
+  return this->_buffer.data() + i * this->_stride + k * this->_plane;
+}
 
 /**
  * @brief Gets the value at a specific location in the image matrix.
@@ -173,7 +303,9 @@ uint Image::channels() { return this->_channels; }
  * @param j Column index.
  * @param k Channel index.
  */
-BYTE Image::get(uint i, uint j, uint k) { return this->_crate[i][j][k]; }
+BYTE Image::get(uint i, uint j, uint k) const {
+  return this->row(i, k)[j * this->_step];
+}
 
 /**
  * @brief Sets a value at a specific location in the image matrix.
@@ -183,118 +315,209 @@ BYTE Image::get(uint i, uint j, uint k) { return this->_crate[i][j][k]; }
  * @param val Value to be set.
  */
 void Image::set(uint i, uint j, uint k, BYTE val) {
-  this->_crate[i][j][k] = val;
+  this->row(i, k)[j * this->_step] = val;
+}
+
+/**
+ * @brief Reads the whole standard input.
+ * @param data Receives the bytes of the input.
+ */
+static void read_stdin(std::vector<BYTE> &data) {
+  data.clear();
+  BYTE chunk[1 << 16];
+  size_t bytes;
+  while ((bytes = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+    data.insert(data.end(), chunk, chunk + bytes);
+  }
+  if (ferror(stdin)) {
+    throw std::runtime_error("Could not read the standard input");
+  }
+}
+
+/**
+ * @brief Maps a regular file into memory.
+ * @param filename Path to the file.
+ * @param size Receives the size of the file.
+ * @return const BYTE* The mapping, nullptr if the file cannot be mapped.
+ */
+static const BYTE *map_file(const std::string &filename, size_t &size) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat info;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    size = info.st_size;
+    map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  return map == MAP_FAILED ? nullptr : (const BYTE *)map;
 }
 
 /**
  * @brief Reads a JPG image from the specified file path.
  * @param filename Path to the JPG image.
+ * @param scale Decode at 1/scale of the size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale from their luma.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @return bool False if the file could not be opened.
  */
-void Image::readJpg(const std::string &filename) {
-  FILE *file = fopen(filename.c_str(), "rb");
-  if (!file) {
-    std::cerr << "[Error] Could not open file " << filename << std::endl;
-    return;
+bool Image::readJpg(const std::string &filename, uint scale, bool fast_dct,
+                    bool gray, uint threads) {
+  // the strips of a parallel decode are cut from the JPG in memory. A file
+  // is mapped, so a JPG that cannot be split is decoded sequentially from
+  // the mapping without a copy; the standard input has to be read
+  if (thread_count(threads) > 1 && filename == "-") {
+    std::vector<BYTE> data;
+    read_stdin(data);
+    this->readJpg(data.data(), data.size(), scale, fast_dct, gray, threads);
+    return true;
   }
-  struct jpeg_decompress_struct cinfo;
-  struct jpeg_error_mgr jerr;
-  cinfo.err = jpeg_std_error(&jerr);
-  jpeg_create_decompress(&cinfo);
-  jpeg_stdio_src(&cinfo, file);
-  jpeg_read_header(&cinfo, TRUE);
-  jpeg_start_decompress(&cinfo);
-  this->_width = cinfo.output_width;
-  this->_height = cinfo.output_height;
-  this->_channels = cinfo.output_components;
-  std::vector<BYTE> data(this->_width * this->_height * this->_channels);
-  JSAMPROW rowPointer[1];
-  while (cinfo.output_scanline < cinfo.output_height) {
-    rowPointer[0] =
-        &data[(cinfo.output_scanline) * this->_width * this->_channels];
-    jpeg_read_scanlines(&cinfo, rowPointer, 1);
-  }
-  jpeg_finish_decompress(&cinfo);
-  jpeg_destroy_decompress(&cinfo);
-  fclose(file);
-  this->_crate.resize(this->_height);
-  for (int i = 0; i < this->_height; i++) {
-    this->_crate[i].resize(this->_width);
-    for (int j = 0; j < this->_width; j++) {
-      this->_crate[i][j].resize(this->_channels);
-      for (int k = 0; k < this->_channels; k++) {
-        this->_crate[i][j][k] =
-            data[(i * this->_width + j) * this->_channels + k];
-      }
+  size_t size = 0;
+  const BYTE *data =
+      thread_count(threads) > 1 ? map_file(filename, size) : nullptr;
+  if (data) {
+    try {
+      this->readJpg(data, size, scale, fast_dct, gray, threads);
+    } catch (const std::exception &) {
+      munmap((void *)data, size);
+      throw;
     }
+    munmap((void *)data, size);
+    return true;
+  }
+  // the reader reports a file that cannot be opened
+  JpegReader reader;
+  if (!reader.open(filename, scale, fast_dct, gray)) {
+    return false;
+  }
+  this->readJpg(reader);
+  return true;
+}
+
+/**
+ * @brief Reads a JPG image held in memory.
+ * @param data The JPG data.
+ * @param size Size of the JPG data in bytes.
+ * @param scale Decode at 1/scale of the size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale from their luma.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void Image::readJpg(const BYTE *data, size_t size, uint scale, bool fast_dct,
+                    bool gray, uint threads) {
+  JpegReader reader;
+  reader.open(data, size, scale, fast_dct, gray);
+  this->_width = reader.width();
+  this->_height = reader.height();
+  this->_channels = reader.channels();
+  this->_allocate();
+  // JPGs without restart markers are decoded sequentially
+  if (!read_jpg_strips(data, size, *this, scale, fast_dct, gray, threads)) {
+    reader.read(*this, 0, this->_height);
   }
+  reader.close();
+}
+
+/**
+ * @brief Reads the rest of a JPG image from an opened reader and closes it.
+ * @param reader Reader that was opened on the JPG image.
+ */
+void Image::readJpg(JpegReader &reader) {
+  this->_width = reader.width();
+  this->_height = reader.height();
+  this->_channels = reader.channels();
+  this->_allocate();
+  reader.read(*this, 0, this->_height);
+  reader.close();
 }
 
 /**
  * @brief Writes the image data to a JPG file.
  * @param filename Path to save the JPG image.
  * @param quality Quality of the saved JPG image (default is 75).
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @return bool False if the file could not be created.
  */
-void Image::writeJpg(const std::string &filename, int quality) {
-  FILE *file = fopen(filename.c_str(), "wb");
-  if (!file) {
-    std::cerr << "[Error] Could not open file " << filename << std::endl;
-    return;
-  }
-  if (this->channels() == 1) {
-    this->_channels = 3;
-    for (int i = 0; i < this->_height; i++) {
-      for (int j = 0; j < this->_width; j++) {
-        this->_crate[i][j].resize(this->_channels);
-        for (int k = 1; k < this->_channels; k++) {
-          this->_crate[i][j][k] = this->_crate[i][j][0];
-        }
-      }
+bool Image::writeJpg(const std::string &filename, int quality, uint threads) {
+  if (thread_count(threads) > 1) {
+    // the file is opened first, as by the writer, and the strips are
+    // written to it as they are stitched
+    FILE *file = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+    if (!file) {
+      std::cerr << "[Error] Could not open file " << filename << std::endl;
+      return false;
     }
-  }
-  struct jpeg_compress_struct cinfo;
-  struct jpeg_error_mgr jerr;
-  cinfo.err = jpeg_std_error(&jerr);
-  jpeg_create_compress(&cinfo);
-  jpeg_stdio_dest(&cinfo, file);
-  cinfo.image_width = this->_width;
-  cinfo.image_height = this->_height;
-  cinfo.input_components = this->_channels;
-  cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&cinfo);
-  jpeg_set_quality(&cinfo, quality, TRUE);
-  jpeg_start_compress(&cinfo, TRUE);
-  std::vector<unsigned char> data(this->_width * this->_height *
-                                  this->_channels);
-  for (int i = 0; i < this->_height; i++) {
-    for (int j = 0; j < this->_width; j++) {
-      for (int k = 0; k < this->_channels; k++) {
-        data[(i * this->_width + j) * this->_channels + k] =
-            this->_crate[i][j][k];
+    bool written;
+    try {
+      written = write_jpg_strips(*this, file, quality, threads);
+    } catch (const std::exception &) {
+      if (file != stdout) {
+        fclose(file);
       }
+      throw;
     }
+    if ((file == stdout ? fflush(file) : fclose(file)) != 0 || !written) {
+      throw std::runtime_error("Could not write " + filename);
+    }
+    return true;
   }
-  JSAMPROW rowPointer[1];
-  while (cinfo.next_scanline < cinfo.image_height) {
-    rowPointer[0] = &data[cinfo.next_scanline * this->_width * this->_channels];
-    jpeg_write_scanlines(&cinfo, rowPointer, 1);
+  JpegWriter writer;
+  if (!writer.open(filename, this->_width, this->_height, quality,
+                   this->_channels == 1 ? 1 : 3)) {
+    return false;
   }
-  jpeg_finish_compress(&cinfo);
-  jpeg_destroy_compress(&cinfo);
-  fclose(file);
+  writer.write(*this, 0, this->_height);
+  writer.close();
+  return true;
+}
+
+/**
+ * @brief Encodes the image data into a JPG in memory.
+ * @param buffer Receives the JPG.
+ * @param quality Quality of the JPG image (default is 75).
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void Image::writeJpg(std::vector<BYTE> &buffer, int quality, uint threads) {
+  if (thread_count(threads) > 1) {
+    write_jpg_strips(*this, buffer, quality, threads);
+    return;
+  }
+  JpegWriter writer;
+  writer.open(buffer, this->_width, this->_height, quality,
+              this->_channels == 1 ? 1 : 3);
+  writer.write(*this, 0, this->_height);
+  writer.close();
 }
 
 /**
  * @brief Converts a RGB image to grayscale.
  */
-Image Image::rgb_2_gray() {
+Image Image::rgb_2_gray() const {
+  if (this->_channels == 1) {
+    return *this;
+  }
   Image grayscale = Image(this->width(), this->height(), 1);
-  // Y = (0.257 * R) + (0.504 * G) + (0.098 * B) + 16
-  for (int i = 0; i < this->height(); i++) {
-    for (int j = 0; j < this->width(); j++) {
-      grayscale.set(i, j, 0,
-                    0.257 * this->get(i, j, 0) + 0.504 * this->get(i, j, 1) +
-                        0.098 * this->get(i, j, 2) + 16);
+  // Y = (0.257 * R) + (0.504 * G) + (0.098 * B) + 16, in fixed point
+  for (uint i = 0; i < this->height(); i++) {
+    if (this->_layout == INTERLEAVED && this->_channels == 3) {
+      rgb_to_gray(this->row(i), grayscale.row(i), this->width());
+      continue;
+    }
+    if (this->_layout == PLANAR) {
+      planes_to_gray(this->row(i, 0), this->row(i, 1), this->row(i, 2),
+                     grayscale.row(i), this->width());
+      continue;
+    }
+    // interleaved with an alpha or extra channel
+    const BYTE *src = this->row(i);
+    BYTE *Y = grayscale.row(i);
+    for (uint j = 0; j < this->width(); j++) {
+      const BYTE *pixel = src + j * this->_step;
+      planes_to_gray(pixel, pixel + 1, pixel + 2, Y + j, 1);
     }
   }
   return grayscale;
-}
\ No newline at end of file
+}
@@ -0,0 +1,141 @@
+#include "batch.h"
+#include "BitImage.h"
+#include "Image.h"
+#include "bilevel.h"
+#include "jpeg.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <dirent.h>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef unsigned int uint;
+
+/**
+ * @brief Returns whether a file name ends with a JPG extension.
+ * @param name File name.
+ */
+static bool is_jpg(const std::string &name) {
+  const size_t dot = name.rfind('.');
+  if (dot == std::string::npos) {
+    return false;
+  }
+  std::string extension = name.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return extension == "jpg" || extension == "jpeg";
+}
+
+/**
+ * @brief Lists the JPG images (.jpg or .jpeg) of a directory.
+ * @param directory Path to the directory.
+ */
+std::vector<std::string> list_images(const std::string &directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    throw std::invalid_argument("Could not read directory " + directory);
+  }
+  std::vector<std::string> names;
+  while (const struct dirent *entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (is_jpg(name)) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+/**
+ * @brief Processes a list of images on a fixed pool of workers.
+ * @param jobs Images to process.
+ * @param workers Number of images processed at once, 0 for one per core.
+ */
+BATCH_REPORT process_batch(const std::vector<BATCH_JOB> &jobs, uint workers) {
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  std::atomic<uint> images(0), failures(0);
+  std::atomic<uint64_t> pixels(0);
+  std::mutex mutex;
+  workers = std::max<size_t>(1, std::min<size_t>(thread_count(workers),
+                                                 jobs.size()));
+  parallel_for(workers, workers, [&](uint) {
+    // the codecs and the image buffer are reused for every image
+    JpegReader reader;
+    JpegWriter writer;
+    BilevelWriter bilevel;
+    Image image;
+    BitImage bits;
+    for (size_t n = next++; n < jobs.size(); n = next++) {
+      const BATCH_JOB &job = jobs[n];
+      // the images run in parallel already, so the stages of an image run
+      // on its worker only instead of multiplying the threads
+      PIPELINE pipeline = job.pipeline;
+      pipeline.threads = 1;
+      std::string partial;
+      try {
+        // the codecs report files that cannot be opened themselves
+        if (!reader.open(job.input, pipeline.scale, pipeline.fast_dct,
+                         pipeline.bw)) {
+          failures++;
+          continue;
+        }
+        const uint64_t size = (uint64_t)reader.width() * reader.height();
+        image.readJpg(reader);
+        const OUTPUT_FORMAT format = output_format(job.output);
+        if (format == JPG) {
+          process(image, pipeline);
+        } else {
+          process(image, bits, pipeline);
+        }
+        partial = partial_output(job.output);
+        if (format == JPG ? !writer.open(partial, image.width(),
+                                         image.height(), 75,
+                                         image.channels() == 1 ? 1 : 3)
+                          : !bilevel.open(partial, image.width(),
+                                          image.height(), image.channels(),
+                                          format)) {
+          finish_output(partial, job.output, false);
+          failures++;
+          continue;
+        }
+        if (format == JPG) {
+          writer.write(image, 0, image.height());
+          writer.close();
+        } else {
+          bilevel.write(bits, 0, bits.height());
+          bilevel.close();
+        }
+        finish_output(partial, job.output, true);
+        images++;
+        pixels += size;
+      } catch (const std::exception &e) {
+        reader.close();
+        writer.close();
+        bilevel.close();
+        if (!partial.empty()) {
+          finish_output(partial, job.output, false);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cerr << "[ERROR] " << job.input << ": " << e.what() << std::endl;
+        failures++;
+      }
+    }
+  });
+  BATCH_REPORT report;
+  report.images = images;
+  report.failures = failures;
+  report.pixels = pixels;
+  report.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return report;
+}
@@ -0,0 +1,379 @@
+#include "bilevel.h"
+#include "Image.h"
+#include "simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+typedef unsigned int uint;
+
+// Number of rows converted per write to the file
+static const uint BILEVEL_BATCH_ROWS = 64;
+
+/**
+ * @brief Closes a file opened by a writer, the standard output is only
+ * flushed.
+ * @param file The file.
+ */
+static void close_file(FILE *file) {
+  if (file == stdout) {
+    fflush(file);
+  } else {
+    fclose(file);
+  }
+}
+
+/**
+ * @brief Returns the output format of a file name from its extension.
+ * @param filename Path of the output image.
+ */
+OUTPUT_FORMAT output_format(const std::string &filename) {
+  const size_t dot = filename.rfind('.');
+  if (dot == std::string::npos) {
+    return JPG;
+  }
+  std::string extension = filename.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (extension == "pbm") {
+    return PBM;
+  }
+  if (extension == "pam") {
+    return PAM;
+  }
+  return JPG;
+}
+
+/**
+ * @brief Returns the path an output image is written to until it is
+ * complete.
+ * @param filename Path of the output image.
+ */
+std::string partial_output(const std::string &filename) {
+  // batch workers may write the same output, so every call gets its own
+  // temporary file
+  static std::atomic<uint> count(0);
+  struct stat status;
+  if (filename == "-" || (lstat(filename.c_str(), &status) == 0 &&
+                          !S_ISREG(status.st_mode))) {
+    return filename;
+  }
+  return filename + ".tmp" + std::to_string((long)getpid()) + "_" +
+         std::to_string(count++);
+}
+
+/**
+ * @brief Completes or discards an output written to partial_output().
+ * @param partial Path returned by partial_output().
+ * @param filename Path of the output image.
+ * @param complete Whether the image was written completely.
+ */
+void finish_output(const std::string &partial, const std::string &filename,
+                   bool complete) {
+  if (partial == filename) {
+    return;
+  }
+  if (!complete) {
+    std::remove(partial.c_str());
+    return;
+  }
+  if (std::rename(partial.c_str(), filename.c_str()) != 0) {
+    std::remove(partial.c_str());
+    throw std::runtime_error("Could not write " + filename);
+  }
+}
+
+/**
+ * @brief Default constructor.
+ */
+BilevelWriter::BilevelWriter()
+    : _file(nullptr), _format(PBM), _width(0), _height(0), _channels(0),
+      _scanline(0), _seekable(false), _origin(0) {}
+
+/**
+ * @brief Destructor, closes the file.
+ */
+BilevelWriter::~BilevelWriter() {
+  if (this->_file) {
+    close_file(this->_file);
+  }
+}
+
+/**
+ * @brief Creates a PBM or PAM file and writes its header.
+ * @param filename Path to save the image.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Channels of the image: 1 for black and white or 3 for RGB.
+ * @param format PBM or PAM.
+ */
+bool BilevelWriter::open(const std::string &filename, uint width, uint height,
+                         uint channels, OUTPUT_FORMAT format) {
+  if (format != PBM && format != PAM) {
+    throw std::invalid_argument("Bilevel images are written as PBM or PAM");
+  }
+  this->_file = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+  if (!this->_file) {
+    std::cerr << "[Error] Could not open file " << filename << std::endl;
+    return false;
+  }
+  this->_format = format;
+  this->_width = width;
+  this->_height = height;
+  this->_channels = channels == 1 ? 1 : 3;
+  this->_scanline = 0;
+  this->_planes.clear();
+  if (format == PAM) {
+    const std::string header =
+        "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " +
+        std::to_string(height) + "\nDEPTH " + std::to_string(this->_channels) +
+        "\nMAXVAL 1\nTUPLTYPE " +
+        (this->_channels == 1 ? "BLACKANDWHITE" : "RGB") + "\nENDHDR\n";
+    this->_put(header.data(), header.size());
+    return true;
+  }
+  this->_header =
+      "P4\n" + std::to_string(width) + " " + std::to_string(height) + "\n";
+  this->_origin = ftell(this->_file);
+  this->_seekable = this->_channels > 1 && this->_origin >= 0;
+  const size_t image = this->_header.size() + (size_t)(width + 7) / 8 * height;
+  if (this->_channels > 1 && !this->_seekable) {
+    // the standard output may be a pipe, so the G and B images wait in memory
+    this->_planes.assign(image * (this->_channels - 1), 0);
+    for (uint k = 1; k < this->_channels; k++) {
+      std::copy(this->_header.begin(), this->_header.end(),
+                this->_planes.begin() + (k - 1) * image);
+    }
+  }
+  for (uint k = 0; k < (this->_seekable ? this->_channels : 1); k++) {
+    if (this->_seekable) {
+      fseek(this->_file, this->_origin + (long)(k * image), SEEK_SET);
+    }
+    this->_put(this->_header.data(), this->_header.size());
+  }
+  return true;
+}
+
+/**
+ * @brief Writes bytes at the current position of the file.
+ * @param data The bytes.
+ * @param bytes Number of bytes.
+ */
+void BilevelWriter::_put(const void *data, size_t bytes) {
+  if (fwrite(data, 1, bytes, this->_file) != bytes) {
+    throw std::runtime_error("Could not write the output image");
+  }
+}
+
+/**
+ * @brief Returns the index of the next row to be written.
+ */
+uint BilevelWriter::scanline() const { return this->_scanline; }
+
+/**
+ * @brief Packs rows of an image into the scratch buffer, plane by plane.
+ * @param image Source with the width of the file.
+ * @param first First source row.
+ * @param rows Number of rows to pack.
+ */
+void BilevelWriter::_pack_planes(const Image &image, uint first, uint rows) {
+  const uint channels = this->_channels;
+  const size_t bytes = (this->_width + 7) / 8;
+  const size_t plane = bytes * rows;
+  std::vector<BYTE> &scratch = this->_scratch;
+  scratch.resize(plane * channels);
+  for (uint r = 0; r < rows; r++) {
+    if (channels == 3 && image.channels() == 3 &&
+        image.layout() == INTERLEAVED) {
+      pack_rgb_bits(image.row(first + r), &scratch[r * bytes],
+                    &scratch[plane + r * bytes], &scratch[2 * plane + r * bytes],
+                    this->_width);
+      continue;
+    }
+    for (uint k = 0; k < channels; k++) {
+      const BYTE *src = image.row(first + r, image.channels() == 1 ? 0 : k);
+      if (image.step() != 1) {
+        this->_samples.resize(this->_width);
+        for (uint j = 0; j < this->_width; j++) {
+          this->_samples[j] = src[j * image.step()];
+        }
+        src = this->_samples.data();
+      }
+      pack_bits(src, &scratch[k * plane + r * bytes], this->_width);
+    }
+  }
+}
+
+/**
+ * @brief Copies rows of a BitImage into the scratch buffer, plane by plane.
+ * @param bits Source with the width of the file.
+ * @param first First source row.
+ * @param rows Number of rows to copy.
+ */
+void BilevelWriter::_pack_planes(const BitImage &bits, uint first,
+                                 uint rows) {
+  const uint channels = this->_channels;
+  const size_t bytes = (this->_width + 7) / 8;
+  const size_t plane = bytes * rows;
+  std::vector<BYTE> &scratch = this->_scratch;
+  scratch.resize(plane * channels);
+  for (uint r = 0; r < rows; r++) {
+    if (bits.channels() == 3 && bits.layout() == INTERLEAVED) {
+      split_rgb_bits(bits.row(first + r), &scratch[r * bytes],
+                     &scratch[plane + r * bytes],
+                     &scratch[2 * plane + r * bytes], this->_width);
+      continue;
+    }
+    for (uint k = 0; k < channels; k++) {
+      const BYTE *src = bits.row(first + r, bits.channels() == 1 ? 0 : k);
+      std::copy(src, src + bytes, &scratch[k * plane + r * bytes]);
+    }
+  }
+}
+
+/**
+ * @brief Writes the planes of the scratch buffer into every PBM image.
+ * @param rows Number of rows in the scratch buffer.
+ */
+void BilevelWriter::_put_planes(uint rows) {
+  const size_t bytes = (this->_width + 7) / 8;
+  const size_t plane = bytes * rows;
+  const size_t image_bytes = this->_header.size() + bytes * this->_height;
+  const size_t offset = this->_header.size() + bytes * this->_scanline;
+  for (uint k = 0; k < this->_channels; k++) {
+    const BYTE *data = &this->_scratch[k * plane];
+    if (k > 0 && !this->_seekable) {
+      std::copy(data, data + plane,
+                this->_planes.begin() + (k - 1) * image_bytes + offset);
+      continue;
+    }
+    if (this->_seekable) {
+      fseek(this->_file, this->_origin + (long)(k * image_bytes + offset),
+            SEEK_SET);
+    }
+    this->_put(data, plane);
+  }
+}
+
+/**
+ * @brief Writes rows [first, first + rows) of an image as the next rows.
+ * @param image Source with the width of the file.
+ * @param first First source row.
+ * @param rows Number of rows to write.
+ */
+void BilevelWriter::write(const Image &image, uint first, uint rows) {
+  const uint channels = this->_channels;
+  const size_t span = (size_t)this->_width * channels;
+  uint done = 0;
+  while (done < rows) {
+    const uint count = std::min(BILEVEL_BATCH_ROWS, rows - done);
+    if (this->_format == PBM) {
+      this->_pack_planes(image, first + done, count);
+      this->_put_planes(count);
+    } else {
+      std::vector<BYTE> &scratch = this->_scratch;
+      scratch.resize(span * count);
+      for (uint r = 0; r < count; r++) {
+        BYTE *dst = &scratch[r * span];
+        if (image.channels() == channels &&
+            (channels == 1 || image.layout() == INTERLEAVED)) {
+          const BYTE *src = image.row(first + done + r);
+          for (size_t n = 0; n < span; n++) {
+            dst[n] = src[n] >> 7;
+          }
+          continue;
+        }
+        for (uint k = 0; k < channels; k++) {
+          const BYTE *src =
+              image.row(first + done + r, image.channels() == 1 ? 0 : k);
+          for (uint j = 0; j < this->_width; j++) {
+            dst[j * channels + k] = src[j * image.step()] >> 7;
+          }
+        }
+      }
+      this->_put(scratch.data(), scratch.size());
+    }
+    done += count;
+    this->_scanline += count;
+  }
+}
+
+/**
+ * @brief Writes rows [first, first + rows) of a halftone as the next rows.
+ * @param bits Source with the width of the file.
+ * @param first First source row.
+ * @param rows Number of rows to write.
+ */
+void BilevelWriter::write(const BitImage &bits, uint first, uint rows) {
+  Image &unpacked = this->_unpacked;
+  uint done = 0;
+  while (done < rows) {
+    const uint count = std::min(BILEVEL_BATCH_ROWS, rows - done);
+    if (this->_format == PBM) {
+      this->_pack_planes(bits, first + done, count);
+      this->_put_planes(count);
+      this->_scanline += count;
+    } else {
+      if (unpacked.width() != bits.width() ||
+          unpacked.height() < BILEVEL_BATCH_ROWS ||
+          unpacked.channels() != bits.channels() ||
+          unpacked.layout() != bits.layout()) {
+        unpacked = Image(bits.width(), BILEVEL_BATCH_ROWS, bits.channels(),
+                         bits.layout());
+      }
+      for (uint r = 0; r < count; r++) {
+        bits.unpack_row(first + done + r, unpacked, r);
+      }
+      this->write(unpacked, 0, count);
+    }
+    done += count;
+  }
+}
+
+/**
+ * @brief Closes the file, after writing the kept PBM images of an image that
+ * was written to the end.
+ */
+void BilevelWriter::close() {
+  if (!this->_file) {
+    return;
+  }
+  // an image that was not written to the end is only closed
+  const bool complete = this->_scanline == this->_height;
+  bool written = !complete || this->_planes.empty() ||
+                 fwrite(this->_planes.data(), 1, this->_planes.size(),
+                        this->_file) == this->_planes.size();
+  written = (this->_file == stdout ? fflush(this->_file) == 0
+                                   : fclose(this->_file) == 0) &&
+            written;
+  this->_file = nullptr;
+  this->_planes.clear();
+  if (complete && !written) {
+    throw std::runtime_error("Could not write the output image");
+  }
+}
+
+/**
+ * @brief Writes a halftone to a PBM or PAM file.
+ * @param bits The halftone, with 1 or 3 channels.
+ * @param filename Path to save the image.
+ * @param format PBM or PAM.
+ */
+bool write_bilevel(const BitImage &bits, const std::string &filename,
+                   OUTPUT_FORMAT format) {
+  BilevelWriter writer;
+  if (!writer.open(filename, bits.width(), bits.height(), bits.channels(),
+                   format)) {
+    return false;
+  }
+  writer.write(bits, 0, bits.height());
+  writer.close();
+  return true;
+}
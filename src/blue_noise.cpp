@@ -0,0 +1,292 @@
+#include "blue_noise.h"
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+typedef unsigned int uint;
+
+/**
+ * @struct BLUE_NOISE_HEADER
+ * @brief Header of a cached mask, followed by dim * dim 16-bit ranks in
+ * native byte order.
+ */
+struct BLUE_NOISE_HEADER {
+  char magic[8];      ///< "BLUENOIS".
+  uint32_t version;   ///< Format version, BLUE_NOISE_VERSION.
+  uint32_t dim;       ///< Dimension of the mask.
+  uint32_t sigma;     ///< Filter deviation in thousandths of a pixel.
+  uint32_t reserved;  ///< Zero.
+};
+
+static const char BLUE_NOISE_MAGIC[8] = {'B', 'L', 'U', 'E',
+                                         'N', 'O', 'I', 'S'};
+static const uint32_t BLUE_NOISE_VERSION = 1;
+static const double BLUE_NOISE_SIGMA = 1.5;
+// Fractional bits of the filter weights, the energies stay below 2^31 for
+// deviations up to several pixels
+static const int BLUE_NOISE_FILTER_BITS = 24;
+
+/**
+ * Generates a blue-noise mask with the void-and-cluster method.
+ * @param dim Dimension of the mask.
+ * @param sigma Standard deviation of the Gaussian filter in pixels.
+ * @return The ranks, row by row.
+ */
+std::vector<uint16_t> void_and_cluster(uint dim, double sigma) {
+  assert(dim >= 2 && dim <= BLUE_NOISE_MAX_DIM);
+  const size_t size = (size_t)dim * dim;
+
+  // Gaussian filter in fixed point, wrapped around the torus. Weights that
+  // round to zero are dropped, so a flip only touches a small window and
+  // the energies are exact integer sums
+  const int radius = std::ceil(
+      sigma * std::sqrt(2 * (BLUE_NOISE_FILTER_BITS + 1) * std::log(2.)));
+  std::vector<int32_t> filter(size, 0);
+  for (int dy = -radius; dy <= radius; dy++) {
+    for (int dx = -radius; dx <= radius; dx++) {
+      const uint y = ((dy % (int)dim) + dim) % dim;
+      const uint x = ((dx % (int)dim) + dim) % dim;
+      filter[y * dim + x] += std::lround(
+          std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma)) *
+          (1 << BLUE_NOISE_FILTER_BITS));
+    }
+  }
+  struct TAP {
+    uint dy, dx;
+    int32_t weight;
+  };
+  std::vector<TAP> taps;
+  std::vector<BYTE> touched(dim, 0);
+  for (uint dy = 0; dy < dim; dy++) {
+    for (uint dx = 0; dx < dim; dx++) {
+      if (filter[dy * dim + dx] > 0) {
+        taps.push_back({dy, dx, filter[dy * dim + dx]});
+        touched[dy] = 1;
+      }
+    }
+  }
+  std::vector<uint> rows; // row offsets reached by the filter
+  for (uint dy = 0; dy < dim; dy++) {
+    if (touched[dy]) {
+      rows.push_back(dy);
+    }
+  }
+
+  // key[1] ranks the set pixels by descending energy to find the tightest
+  // cluster, key[0] the unset pixels by ascending energy to find the
+  // largest void, and every row keeps the minimum of its keys
+  std::vector<BYTE> pattern(size, 0);
+  std::vector<int32_t> energy(size, 0);
+  std::vector<int32_t> key[2] = {std::vector<int32_t>(size, 0),
+                                 std::vector<int32_t>(size, INT32_MAX)};
+  std::vector<int32_t> row_min[2] = {std::vector<int32_t>(dim, 0),
+                                     std::vector<int32_t>(dim, INT32_MAX)};
+  auto update_row = [&](BYTE set, uint y) {
+    const int32_t *keys = &key[set][(size_t)y * dim];
+    int32_t minimum = INT32_MAX;
+    for (uint x = 0; x < dim; x++) {
+      minimum = std::min(minimum, keys[x]);
+    }
+    row_min[set][y] = minimum;
+  };
+  auto flip = [&](size_t p) {
+    const int32_t sign = pattern[p] ? -1 : 1;
+    pattern[p] ^= 1;
+    const uint y = p / dim, x = p % dim;
+    for (const TAP &tap : taps) {
+      const size_t q = (size_t)((y + tap.dy) % dim) * dim + (x + tap.dx) % dim;
+      energy[q] += sign * tap.weight;
+      key[1][q] = pattern[q] ? -energy[q] : INT32_MAX;
+      key[0][q] = pattern[q] ? INT32_MAX : energy[q];
+    }
+    for (uint dy : rows) {
+      update_row(0, (y + dy) % dim);
+      update_row(1, (y + dy) % dim);
+    }
+  };
+  // returns the first pixel of lowest key, set = 1 for the tightest cluster
+  // and set = 0 for the largest void
+  auto find = [&](BYTE set) {
+    const std::vector<int32_t> &mins = row_min[set];
+    const uint y = std::min_element(mins.begin(), mins.end()) - mins.begin();
+    const int32_t *keys = &key[set][(size_t)y * dim];
+    return (size_t)y * dim + (std::find(keys, keys + dim, mins[y]) - keys);
+  };
+
+  // initial pattern: random pixels, relaxed until the pixel removed from
+  // the tightest cluster is the one that fills the largest void
+  const size_t ones = std::max<size_t>(1, size / 10);
+  std::mt19937 random(dim);
+  for (size_t placed = 0; placed < ones;) {
+    const size_t p = random() % size;
+    if (!pattern[p]) {
+      flip(p);
+      placed++;
+    }
+  }
+  for (size_t step = 0; step < size; step++) {
+    const size_t cluster = find(1);
+    flip(cluster);
+    const size_t grown = find(0);
+    flip(grown);
+    if (grown == cluster) {
+      break;
+    }
+  }
+  const std::vector<BYTE> initial_pattern = pattern;
+
+  std::vector<uint16_t> ranks(size);
+  // phase 1: the initial pixels are ranked by removing the tightest cluster
+  for (size_t rank = ones; rank-- > 0;) {
+    const size_t cluster = find(1);
+    flip(cluster);
+    ranks[cluster] = rank;
+  }
+  // phases 2 and 3: the other pixels are ranked by filling the largest void.
+  // Past half the pixels the tightest cluster of unset pixels is searched,
+  // whose energy is the total filter weight minus energy, so it also is the
+  // unset pixel of lowest energy
+  for (size_t p = 0; p < size; p++) {
+    if (initial_pattern[p]) {
+      flip(p);
+    }
+  }
+  for (size_t rank = ones; rank < size; rank++) {
+    const size_t grown = find(0);
+    flip(grown);
+    ranks[grown] = rank;
+  }
+  return ranks;
+}
+
+/**
+ * Returns the default path of the cached mask of a dimension.
+ * @param dim Dimension of the mask.
+ * @return Path of the cache file.
+ */
+std::string blue_noise_cache(uint dim) {
+  const std::string name = "blue_noise_" + std::to_string(dim) + ".bin";
+  std::string directory;
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME")) {
+    directory = xdg;
+  } else if (const char *home = std::getenv("HOME")) {
+    directory = std::string(home) + "/.cache";
+  } else {
+    return name;
+  }
+  mkdir(directory.c_str(), 0755);
+  directory += "/image_print";
+  mkdir(directory.c_str(), 0755);
+  return directory + "/" + name;
+}
+
+/**
+ * Reads a cached mask and checks that it was made with BLUE_NOISE_SIGMA and
+ * holds every rank of dim once.
+ * @param filename Path of the cache file.
+ * @param dim Dimension of the mask.
+ * @param ranks Receives the ranks of a valid file.
+ * @return Whether the file is a valid mask of dim.
+ */
+static bool read_mask(const std::string &filename, uint dim,
+                      std::vector<uint16_t> &ranks) {
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  const size_t size = (size_t)dim * dim;
+  BLUE_NOISE_HEADER header;
+  ranks.resize(size);
+  // the file has to end after the ranks
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               fread(ranks.data(), sizeof(uint16_t), size, file) == size &&
+               fgetc(file) == EOF;
+  fclose(file);
+  valid = valid && std::memcmp(header.magic, BLUE_NOISE_MAGIC, 8) == 0 &&
+          header.version == BLUE_NOISE_VERSION && header.dim == dim &&
+          header.sigma == (uint32_t)std::lround(BLUE_NOISE_SIGMA * 1000);
+  std::vector<BYTE> seen(size, 0);
+  for (size_t n = 0; n < size && valid; n++) {
+    valid = ranks[n] < size && !seen[ranks[n]];
+    seen[ranks[n] % size] = 1;
+  }
+  return valid;
+}
+
+/**
+ * Writes a mask to its cache file, through a temporary file renamed in
+ * place so that concurrent runs never read a partial file.
+ * @param filename Path of the cache file.
+ * @param dim Dimension of the mask.
+ * @param ranks The ranks, row by row.
+ * @return Whether the file was written.
+ */
+static bool write_mask(const std::string &filename, uint dim,
+                       const std::vector<uint16_t> &ranks) {
+  BLUE_NOISE_HEADER header = {};
+  std::memcpy(header.magic, BLUE_NOISE_MAGIC, 8);
+  header.version = BLUE_NOISE_VERSION;
+  header.dim = dim;
+  header.sigma = (uint32_t)std::lround(BLUE_NOISE_SIGMA * 1000);
+  const std::string temporary =
+      filename + ".tmp" + std::to_string((long)getpid());
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(ranks.data(), sizeof(uint16_t), ranks.size(), file) ==
+          ranks.size();
+  written = fclose(file) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Returns the threshold matrix of a blue-noise mask, loaded from its cache
+ * file and generated when the file is missing or invalid.
+ * @param dim Dimension of the mask.
+ * @param cache Path of the cache file.
+ * @return The threshold matrix.
+ */
+mCRATE blue_noise_matrix(uint dim, const std::string &cache) {
+  if (dim < BLUE_NOISE_MIN_DIM || dim > BLUE_NOISE_MAX_DIM ||
+      (dim & (dim - 1)) != 0) {
+    throw std::invalid_argument(
+        "Blue-noise masks are powers of 2 between " +
+        std::to_string(BLUE_NOISE_MIN_DIM) + " and " +
+        std::to_string(BLUE_NOISE_MAX_DIM));
+  }
+  std::vector<uint16_t> ranks;
+  if (!read_mask(cache, dim, ranks)) {
+    ranks = void_and_cluster(dim, BLUE_NOISE_SIGMA);
+    if (!write_mask(cache, dim, ranks)) {
+      std::cerr << "[WARNING] Could not write blue-noise mask " << cache
+                << std::endl;
+    }
+  }
+  // thresholds are spread over the ranks like those of the Bayer matrix
+  const size_t size = (size_t)dim * dim;
+  mCRATE res(dim, std::vector<BYTE>(dim));
+  for (uint i = 0; i < dim; i++) {
+    for (uint j = 0; j < dim; j++) {
+      res[i][j] = ((ranks[(size_t)i * dim + j] + 0.5) / size) * 255;
+    }
+  }
+  return res;
+}
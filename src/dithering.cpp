@@ -1,5 +1,13 @@
+#include "BitImage.h"
 #include "Image.h"
+#include "dithering.h"
+#include "parallel.h"
+#include "simd.h"
+#include <algorithm>
 #include <assert.h>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 // Define byte and matrix crate type aliases
@@ -7,57 +15,234 @@ typedef unsigned char BYTE;
 typedef std::vector<std::vector<BYTE>> mCRATE;
 
 /**
- * Generates a dithering matrix of specified dimensions.
- * @param dim Dimension of the dithering matrix (should be power of 2).
- * @return A 2D dithering matrix.
+ * Returns the rank of a cell of the Bayer matrix of the given dimension.
+ * The matrix of dim is made of four copies of the matrix of dim / 2 with
+ * ranks 4 * rank + 1, + 2, + 3 and + 0 in the top left, top right, bottom
+ * left and bottom right quadrants, so every level of quadrants is one base
+ * 4 digit of the rank, the outermost level being the least significant.
+ * @param dim Dimension of the matrix (power of 2).
+ * @param i Row of the cell.
+ * @param j Column of the cell.
+ * @return The rank, between 0 and dim * dim - 1.
  */
-mCRATE dithering_matrix(unsigned int dim) {
-  // Ensure dimension is valid
-  assert(dim >= 2);
-
-  // Initialize a matrix with the given dimensions
-  mCRATE res(dim, std::vector<BYTE>(dim));
-
-  // Base case: 2x2 matrix
-  if (dim == 2) {
-    res = {{1, 2}, {3, 0}};
-  } else {
-    // Recursive case: split the matrix
-    int ndim = dim / 2;
-    mCRATE part = dithering_matrix(ndim);
-
-    // Populate the resulting matrix by combining sub-matrices
-    for (int i = 0; i < ndim; i++) {
-      for (int j = 0; j < ndim; j++) {
-        res[i][j] = 4 * part[i][j] + 1;
-        res[i][j + ndim] = 4 * part[i][j] + 2;
-        res[i + ndim][j] = 4 * part[i][j] + 3;
-        res[i + ndim][j + ndim] = 4 * part[i][j];
+static constexpr uint16_t bayer_rank(unsigned int dim, unsigned int i,
+                                     unsigned int j) {
+  unsigned int rank = 0;
+  for (unsigned int bit = dim / 2, digit = 1; bit > 0; bit /= 2, digit *= 4) {
+    const unsigned int a = (i & bit) ? 1 : 0, b = (j & bit) ? 1 : 0;
+    rank += ((2 * a + b + 1) & 3) * digit;
+  }
+  return rank;
+}
+
+/**
+ * @struct BAYER_TABLE
+ * @brief Ranks and thresholds of the Bayer matrix of DIM, computed by the
+ * compiler.
+ */
+template <unsigned int DIM> struct BAYER_TABLE {
+  uint16_t ranks[DIM * DIM] = {};
+  BYTE thresholds[DIM * DIM] = {};
+
+  constexpr BAYER_TABLE() {
+    for (unsigned int i = 0; i < DIM; i++) {
+      for (unsigned int j = 0; j < DIM; j++) {
+        ranks[i * DIM + j] = bayer_rank(DIM, i, j);
+        thresholds[i * DIM + j] =
+            ((ranks[i * DIM + j] + 0.5) / (DIM * DIM)) * 255;
       }
     }
   }
-  return res;
+};
+
+// The tables live in read-only data, nothing is computed at startup
+template <unsigned int DIM>
+static constexpr BAYER_TABLE<DIM> BAYER_TABLES = BAYER_TABLE<DIM>();
+
+static_assert(BAYER_TABLES<2>.ranks[0] == 1 && BAYER_TABLES<2>.ranks[1] == 2 &&
+                  BAYER_TABLES<2>.ranks[2] == 3 && BAYER_TABLES<2>.ranks[3] == 0,
+              "Bayer base matrix");
+
+/**
+ * Returns a Bayer matrix of specified dimensions from the static tables.
+ * @param dim Dimension of the matrix (power of 2 up to BAYER_MAX_DIM).
+ * @return The matrix.
+ */
+BAYER_MATRIX bayer_matrix(unsigned int dim) {
+  switch (dim) {
+  case 2:
+    return {2, BAYER_TABLES<2>.ranks, BAYER_TABLES<2>.thresholds};
+  case 4:
+    return {4, BAYER_TABLES<4>.ranks, BAYER_TABLES<4>.thresholds};
+  case 8:
+    return {8, BAYER_TABLES<8>.ranks, BAYER_TABLES<8>.thresholds};
+  case 16:
+    return {16, BAYER_TABLES<16>.ranks, BAYER_TABLES<16>.thresholds};
+  case 32:
+    return {32, BAYER_TABLES<32>.ranks, BAYER_TABLES<32>.thresholds};
+  case 64:
+    return {64, BAYER_TABLES<64>.ranks, BAYER_TABLES<64>.thresholds};
+  case 128:
+    return {128, BAYER_TABLES<128>.ranks, BAYER_TABLES<128>.thresholds};
+  case 256:
+    return {256, BAYER_TABLES<256>.ranks, BAYER_TABLES<256>.thresholds};
+  }
+  throw std::invalid_argument("Bayer matrices are powers of 2 between 2 and " +
+                              std::to_string(BAYER_MAX_DIM));
+}
+
+/**
+ * Returns the strip to be used for an image row.
+ * @param i Row index within the full image.
+ */
+const BYTE *THRESHOLD_STRIPS::row(unsigned int i) const {
+  return &data[(i % dim) * length];
 }
 
 /**
- * Converts a dithering matrix to a threshold matrix.
- * @param dithering_matrix The input dithering matrix.
- * @return A 2D threshold matrix.
+ * Expands a square threshold matrix into strips.
+ * @param threshold The threshold matrix.
+ * @param samples Samples per pixel in an image row.
+ * @return The threshold strips.
  */
-mCRATE threshold_matrix(mCRATE dithering_matrix) {
-  // Ensure matrix is square
-  assert(dithering_matrix.size() == dithering_matrix[0].size());
+THRESHOLD_STRIPS threshold_strips(const mCRATE &threshold,
+                                  unsigned int samples) {
+  assert(threshold.size() == threshold[0].size());
+  const unsigned int dim = threshold.size();
 
-  const int dim = dithering_matrix.size();
-  mCRATE res(dim, std::vector<BYTE>(dim));
+  // The strip length is a multiple of both the matrix period and the
+  // vector width, so every strip restart is at a full vector
+  const size_t period = (size_t)dim * samples;
+  size_t length = period;
+  while (length % 32 != 0) {
+    length += period;
+  }
+  THRESHOLD_STRIPS strips;
+  strips.dim = dim;
+  strips.length = length;
+  strips.data.resize(dim * length);
+  for (unsigned int tx = 0; tx < dim; tx++) {
+    BYTE *strip = &strips.data[tx * length];
+    for (size_t n = 0; n < length; n++) {
+      strip[n] = threshold[tx][n / samples % dim];
+    }
+  }
+  return strips;
+}
 
-  // Calculate threshold values based on dithering matrix values
-  for (int i = 0; i < dim; i++) {
-    for (int j = 0; j < dim; j++) {
-      res[i][j] = ((dithering_matrix[i][j] + 0.5) / (dim * dim)) * 255;
+/**
+ * Expands the threshold matrix of the given dimension into strips.
+ * @param dim Dimension of the dithering matrix.
+ * @param samples Samples per pixel in an image row.
+ * @return The threshold strips.
+ */
+THRESHOLD_STRIPS threshold_strips(unsigned int dim, unsigned int samples) {
+  const BAYER_MATRIX bayer = bayer_matrix(dim);
+
+  // Row and column 0 of the image use the last row and column of the
+  // matrix, the others the row and column of their index modulo dim
+  mCRATE shifted(dim, std::vector<BYTE>(dim));
+  for (unsigned int tx = 0; tx < dim; tx++) {
+    for (unsigned int ty = 0; ty < dim; ty++) {
+      shifted[tx][ty] = bayer.thresholds[(tx > 0 ? tx : dim - 1) * dim +
+                                         (ty > 0 ? ty : dim - 1)];
     }
   }
-  return res;
+  return threshold_strips(shifted, samples);
+}
+
+/**
+ * Runs a row function over the rows of an image, split into one band per
+ * thread whose height is a multiple of the matrix dimension.
+ * @param height Number of rows.
+ * @param dim Dimension of the dithering matrix.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param dither_row Dithers row i.
+ */
+template <typename ROW>
+static void dither_bands(unsigned int height, unsigned int dim,
+                         unsigned int threads, ROW dither_row) {
+  threads = thread_count(threads);
+  unsigned int band = (height + threads - 1) / threads;
+  band = std::max(dim, (band + dim - 1) / dim * dim);
+  const unsigned int bands = (height + band - 1) / band;
+  parallel_for(bands, threads, [&](unsigned int b) {
+    const unsigned int last = std::min(height, (b + 1) * band);
+    for (uint i = b * band; i < last; i++) {
+      dither_row(i);
+    }
+  });
+}
+
+/**
+ * Apply dithering to an image in place with precomputed threshold strips.
+ * @param image The image to dither.
+ * @param strips Threshold strips created for the layout of image.
+ * @param offset Row index of the first row of image within the full image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void dither_inplace(Image &image, const THRESHOLD_STRIPS &strips,
+                    unsigned int offset, unsigned int threads) {
+  const unsigned int planes =
+      image.layout() == PLANAR ? image.channels() : 1;
+  const size_t span = image.span();
+  dither_bands(image.height(), strips.dim, threads, [&](uint i) {
+    const BYTE *strip = strips.row(i + offset);
+    for (uint k = 0; k < planes; k++) {
+      BYTE *row = image.row(i, k);
+      // Set every sample to 0 or 255 based on its threshold value
+      for (size_t n = 0; n < span; n += strips.length) {
+        threshold_row(row + n, strip, row + n,
+                      std::min(strips.length, span - n));
+      }
+    }
+  });
+}
+
+/**
+ * Apply dithering to an image with precomputed threshold strips, writing one
+ * bit per sample.
+ * @param image The image to dither.
+ * @param bits Receives the halftone, resized to the shape of image.
+ * @param strips Threshold strips created for the layout of image.
+ * @param offset Row index of the first row of image within the full image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void dither(const Image &image, BitImage &bits, const THRESHOLD_STRIPS &strips,
+            unsigned int offset, unsigned int threads) {
+  if (bits.width() != image.width() || bits.height() != image.height() ||
+      bits.channels() != image.channels() ||
+      bits.layout() != image.layout()) {
+    bits.resize(image.width(), image.height(), image.channels(),
+                image.layout());
+  }
+  const unsigned int planes =
+      image.layout() == PLANAR ? image.channels() : 1;
+  const size_t span = image.span();
+  // the strip length is a multiple of 32, so every piece starts on a byte
+  dither_bands(image.height(), strips.dim, threads, [&](uint i) {
+    const BYTE *strip = strips.row(i + offset);
+    for (uint k = 0; k < planes; k++) {
+      const BYTE *row = image.row(i, k);
+      BYTE *dst = bits.row(i, k);
+      for (size_t n = 0; n < span; n += strips.length) {
+        threshold_bits(row + n, strip, dst + n / 8,
+                       std::min(strips.length, span - n));
+      }
+    }
+  });
+}
+
+/**
+ * Apply dithering to an image in place using the specified matrix dimension.
+ * @param image The image to dither.
+ * @param dim Dimension of the dithering matrix.
+ * @param offset Row index of the first row of image within the full image.
+ */
+void dither_inplace(Image &image, unsigned int dim, unsigned int offset) {
+  const unsigned int samples =
+      image.layout() == PLANAR ? 1 : image.channels();
+  dither_inplace(image, threshold_strips(dim, samples), offset);
 }
 
 /**
@@ -67,26 +252,6 @@ mCRATE threshold_matrix(mCRATE dithering_matrix) {
  * @return Dithered image.
  */
 Image dithering(Image image, unsigned int dim) {
-  // Generate dithering and threshold matrices
-  mCRATE dithering = dithering_matrix(dim);
-  mCRATE threshold = threshold_matrix(dithering);
-
-  // Loop through each pixel of the image
-  for (int i = 0; i < image.height(); i++) {
-    for (int j = 0; j < image.width(); j++) {
-      for (int k = 0; k < image.channels(); k++) {
-        // Determine threshold indices for the current pixel
-        int tx = i % dim > 0 ? i % dim : dim - 1;
-        int ty = j % dim > 0 ? j % dim : dim - 1;
-
-        // Set the pixel value based on the threshold value
-        if (image.get(i, j, k) <= threshold[tx][ty]) {
-          image.set(i, j, k, 0);
-        } else {
-          image.set(i, j, k, 255);
-        }
-      }
-    }
-  }
+  dither_inplace(image, dim);
   return image;
 }
@@ -1,65 +1,22 @@
 #include "Image.h"
+#include "error_diffusion.h"
+#include "parallel.h"
+#include <algorithm>
 #include <assert.h>
-#include <map>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#if defined(__AVX__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
 #include "diffusion_kernel.h"
 
 typedef unsigned int uint;
-typedef std::vector<std::vector<double>> VECTOR_DOUBLE_2D;
-typedef std::vector<VECTOR_DOUBLE_2D> VECTOR_DOUBLE_3D;
-typedef std::vector<BYTE> VECTOR_BYTE;
-
-// Map containing the diffusion kernel matrices for various algorithms
-std::map<DIFFUSION_KERNEL, VECTOR_DOUBLE_2D> DIFFUSION_KERNELS = {
-    {DIFFUSION_KERNEL::FLOYD_STEINBERG,
-     {{0. / 16, 0. / 16, 0. / 16},
-      {0. / 16, 0. / 16, 7. / 16},
-      {3. / 16, 5. / 16, 1. / 16}}},
-    {DIFFUSION_KERNEL::JARVIS_JUDICE_NINKE,
-     {
-         {0. / 48, 0. / 48, 0. / 48, 0. / 48, 0. / 48},
-         {0. / 48, 0. / 48, 0. / 48, 0. / 48, 0. / 48},
-         {0. / 48, 0. / 48, 0. / 48, 7. / 48, 5. / 48},
-         {3. / 48, 5. / 48, 7. / 48, 5. / 48, 3. / 48},
-         {1. / 48, 3. / 48, 5. / 48, 3. / 48, 1. / 48},
-     }},
-    {DIFFUSION_KERNEL::STUCKI,
-     {{
-          0. / 42,
-          0. / 42,
-          0. / 42,
-          0. / 42,
-          0. / 42,
-      },
-      {
-          0. / 42,
-          0. / 42,
-          0. / 42,
-          0. / 42,
-          0. / 42,
-      },
-      {
-          0. / 42,
-          0. / 42,
-          0. / 42,
-          8. / 42,
-          4. / 42,
-      },
-      {
-          2. / 42,
-          4. / 42,
-          8. / 42,
-          4. / 42,
-          2. / 42,
-      },
-      {
-          1. / 42,
-          2. / 42,
-          4. / 42,
-          2. / 42,
-          1. / 42,
-      }}}};
 
 /**
  * @brief Finds the nearest vertex for given RGB values based on a specific MBVQ type.
@@ -72,267 +29,878 @@ std::map<DIFFUSION_KERNEL, VECTOR_DOUBLE_2D> DIFFUSION_KERNELS = {
  */
 COLOR get_nearest_vertex(const MBVQ mbvq, const float R, const float G,
                          const float B) {
-  COLOR vertex;
-  if (mbvq == MBVQ::CMYW) {
-    vertex = COLOR::WHITE;
-    if (B < 0.5) {
-      if (B <= R) {
-        if (B <= G) {
-          vertex = COLOR::YELLOW;
-        }
-      }
-    }
-    if (G < 0.5) {
-      if (G <= B) {
-        if (G <= R) {
-          vertex = COLOR::MAGENTA;
-        }
-      }
-    }
-    if (R < 0.5) {
-      if (R <= B) {
-        if (R <= G) {
-          vertex = COLOR::CYAN;
-        }
-      }
-    }
-  }
+  // the vertex is computed for every tetrahedron with selects only and the
+  // one of mbvq is picked, so no branch depends on the color
+  COLOR vertex[6];
+  vertex[MBVQ::CMYW] = (R < 0.5) & (R <= B) & (R <= G)   ? COLOR::CYAN
+                       : (G < 0.5) & (G <= B) & (G <= R) ? COLOR::MAGENTA
+                       : (B < 0.5) & (B <= R) & (B <= G) ? COLOR::YELLOW
+                                                         : COLOR::WHITE;
+  const COLOR cyan_green = B >= 0.5 ? COLOR::CYAN : COLOR::GREEN;
+  const COLOR yellow_green = R >= 0.5 ? COLOR::YELLOW : COLOR::GREEN;
+  vertex[MBVQ::MYGC] = (G >= R) & (B >= R)   ? cyan_green
+                       : (G >= B) & (R >= B) ? yellow_green
+                                             : COLOR::MAGENTA;
+  const COLOR rgmy[2][2] = {
+      {R >= G ? COLOR::RED : COLOR::GREEN,
+       G >= 0.5 ? COLOR::YELLOW : COLOR::RED},
+      {G > B + R ? COLOR::GREEN : COLOR::MAGENTA,
+       B >= G ? COLOR::MAGENTA : COLOR::YELLOW}};
+  vertex[MBVQ::RGMY] = rgmy[B > 0.5][B > 0.5 ? R > 0.5 : R >= 0.5];
+  vertex[MBVQ::KRGB] = (R > 0.5) & (R >= B) & (R >= G)   ? COLOR::RED
+                       : (G > 0.5) & (G >= B) & (G >= R) ? COLOR::GREEN
+                       : (B > 0.5) & (B >= R) & (B >= G) ? COLOR::BLUE
+                                                         : COLOR::BLACK;
+  const COLOR blue_magenta = R < 0.5 ? COLOR::BLUE : COLOR::MAGENTA;
+  const COLOR red_magenta = B < 0.5 ? COLOR::RED : COLOR::MAGENTA;
+  vertex[MBVQ::RGBM] = (B > G) & (B >= R)   ? blue_magenta
+                       : (R > G) & (R >= B) ? red_magenta
+                                            : COLOR::GREEN;
+  const COLOR cmgb[2][2] = {
+      {G >= B ? COLOR::GREEN : COLOR::BLUE,
+       R - G + B >= 0.5 ? COLOR::MAGENTA : COLOR::GREEN},
+      {G > 0.5 ? COLOR::CYAN : COLOR::BLUE,
+       G >= R ? COLOR::CYAN : COLOR::MAGENTA}};
+  vertex[MBVQ::CMGB] = cmgb[B > 0.5][R > 0.5];
+  return vertex[mbvq];
+}
 
-  if (mbvq == MBVQ::MYGC) {
-    vertex = COLOR::MAGENTA;
-    if (G >= B) {
-      if (R >= B) {
-        if (R >= 0.5) {
-          vertex = COLOR::YELLOW;
-        } else {
-          vertex = COLOR::GREEN;
-        }
-      }
-    }
-    if (G >= R) {
-      if (B >= R) {
-        if (B >= 0.5) {
-          vertex = COLOR::CYAN;
-        } else {
-          vertex = COLOR::GREEN;
-        }
-      }
-    }
+/**
+ * @brief Determines the MBVQ type based on the given RGB values.
+ * 
+ * @param R Red component of the color.
+ * @param G Green component of the color.
+ * @param B Blue component of the color.
+ * @return MBVQ The MBVQ type corresponding to the RGB values.
+ */
+MBVQ get_mbvq(BYTE R, BYTE G, BYTE B) {
+  // indexed by the sides of the planes R + G = 255, G + B = 255 and
+  // R + G + B = 510 (upper half) or R + G + B = 255 (lower half)
+  static const MBVQ TETRAHEDRA[2][2][2] = {
+      {{MBVQ::KRGB, MBVQ::RGBM}, {MBVQ::CMGB, MBVQ::CMGB}},
+      {{MBVQ::RGMY, MBVQ::RGMY}, {MBVQ::MYGC, MBVQ::CMYW}}};
+  const int upper = R + G > 255;
+  return TETRAHEDRA[upper][G + B > 255][R + G + B > 255 + 255 * upper];
+}
+
+/**
+ * @brief Retrieves the color for a RGB pixel based on MBVQ technique.
+ * 
+ * @param pixel Color data of the pixel, R, G and B.
+ * @return uint32_t Packed RGB values for the pixel, red in the lowest byte.
+ */
+uint32_t get_mbvq_color(const double *pixel) {
+  // packed RGB of every COLOR
+  static const uint32_t VERTEX_RGB[8] = {
+      0x0000FF, // RED
+      0x00FF00, // GREEN
+      0xFF0000, // BLUE
+      0xFFFFFF, // WHITE
+      0xFF00FF, // MAGENTA
+      0xFFFF00, // CYAN
+      0x00FFFF, // YELLOW
+      0x000000  // BLACK
+  };
+  // samples outside 0 to 255 wrap around when converted to BYTE
+  const MBVQ mbvq = get_mbvq((BYTE)(int)pixel[0], (BYTE)(int)pixel[1],
+                             (BYTE)(int)pixel[2]);
+  return VERTEX_RGB[get_nearest_vertex(mbvq, pixel[0] / 255.,
+                                       pixel[1] / 255., pixel[2] / 255.)];
+}
+
+/**
+ * @brief Constructor.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of color channels.
+ * @param kernel_type Type of diffusion kernel to be used.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param first Index of the first image channel handled.
+ * @param fixed Keep the state in fixed-point integers instead of doubles.
+ */
+ErrorDiffuser::ErrorDiffuser(uint width, uint height, uint channels,
+                             DIFFUSION_KERNEL kernel_type, bool isMBVQ,
+                             double threshold, uint first, bool fixed)
+    : _width(width), _height(height), _channels(channels),
+      _stride(channels == 3 ? 4 : channels), _first(first),
+      _kernel_type(kernel_type),
+      _si(kernel_type == FLOYD_STEINBERG
+              ? KERNEL_TAPS<FLOYD_STEINBERG>::rows
+              : kernel_type == JARVIS_JUDICE_NINKE
+                    ? KERNEL_TAPS<JARVIS_JUDICE_NINKE>::rows
+                    : KERNEL_TAPS<STUCKI>::rows),
+      _isMBVQ(isMBVQ), _threshold(threshold), _fixed(fixed), _pushed(0),
+      _popped(0) {
+  assert(kernel_type != CUSTOM);
+  this->_allocate();
+}
+
+/**
+ * @brief Constructor for a kernel loaded at runtime.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of color channels.
+ * @param kernel Taps of the kernel.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param first Index of the first image channel handled.
+ * @param fixed Keep the state in fixed-point integers instead of doubles.
+ */
+ErrorDiffuser::ErrorDiffuser(uint width, uint height, uint channels,
+                             const CUSTOM_KERNEL &kernel, bool isMBVQ,
+                             double threshold, uint first, bool fixed)
+    : _width(width), _height(height), _channels(channels),
+      _stride(channels == 3 ? 4 : channels), _first(first),
+      _kernel_type(CUSTOM), _custom(kernel), _si(kernel.rows),
+      _isMBVQ(isMBVQ), _threshold(threshold), _fixed(fixed), _pushed(0),
+      _popped(0) {
+  assert(kernel.rows <= KERNEL_MAX_ROWS);
+  this->_allocate();
+}
+
+/**
+ * @brief Allocates the ring of _si + 1 rows.
+ */
+void ErrorDiffuser::_allocate() {
+  assert(this->_isMBVQ && this->_channels == 3 || !this->_isMBVQ);
+  const size_t size = (size_t)(this->_si + 1) * this->_width * this->_stride;
+  if (this->_fixed) {
+    this->_fixed_window.resize(size);
+  } else {
+    this->_window.resize(size);
   }
+}
 
-  if (mbvq == MBVQ::RGMY) {
-    if (B > 0.5) {
-      if (R > 0.5) {
-        if (B >= G) {
-          vertex = COLOR::MAGENTA;
-        } else {
-          vertex = COLOR::YELLOW;
-        }
-      } else {
-        if (G > B + R) {
-          vertex = COLOR::GREEN;
-        } else {
-          vertex = COLOR::MAGENTA;
-        }
+/**
+ * @brief Returns the color data of row x in the ring of doubles.
+ */
+template <> double *ErrorDiffuser::_row<double>(uint x) {
+  return &this->_window[(size_t)(x % (this->_si + 1)) * this->_width *
+                        this->_stride];
+}
+
+/**
+ * @brief Returns the color data of row x in the ring of fixed-point values.
+ */
+template <> int32_t *ErrorDiffuser::_row<int32_t>(uint x) {
+  return &this->_fixed_window[(size_t)(x % (this->_si + 1)) * this->_width *
+                              this->_stride];
+}
+
+/**
+ * @brief Returns whether the next row can be popped.
+ */
+bool ErrorDiffuser::ready() const {
+  // the kernel reaches _si rows below the popped row, all of them have to
+  // hold their input before they receive any error
+  return this->_popped < this->_pushed &&
+         (this->_pushed > this->_popped + this->_si ||
+          this->_pushed == this->_height);
+}
+
+/**
+ * @brief Pushes the next input row.
+ * @param image Image holding the row.
+ * @param i Row index in image.
+ */
+void ErrorDiffuser::push(const Image &image, uint i) {
+  assert(this->_pushed < this->_height && this->_pushed <= this->_popped + this->_si);
+  for (size_t ch = 0; ch < this->_channels; ++ch) {
+    const BYTE *src = image.row(i, this->_first + ch);
+    if (this->_fixed) {
+      int32_t *dst = this->_row<int32_t>(this->_pushed);
+      for (size_t j = 0; j < this->_width; ++j) {
+        dst[j * this->_stride + ch] = (int32_t)src[j * image.step()]
+                                        << FIXED_STATE_BITS;
       }
     } else {
-      if (R >= 0.5) {
-        if (G >= 0.5) {
-          vertex = COLOR::YELLOW;
-        } else {
-          vertex = COLOR::RED;
-        }
-      } else {
-        if (R >= G) {
-          vertex = COLOR::RED;
-        } else {
-          vertex = COLOR::GREEN;
-        }
+      double *dst = this->_row<double>(this->_pushed);
+      for (size_t j = 0; j < this->_width; ++j) {
+        dst[j * this->_stride + ch] = (double)src[j * image.step()];
       }
     }
   }
+  this->_pushed++;
+}
 
-  if (mbvq == MBVQ::KRGB) {
-    vertex = COLOR::BLACK;
-    if (B > 0.5) {
-      if (B >= R) {
-        if (B >= G) {
-          vertex = COLOR::BLUE;
-        }
-      }
+/**
+ * @brief Returns a sample of the state as color value.
+ */
+static inline double sample_value(double sample) { return sample; }
+
+/**
+ * @brief Returns a fixed-point sample of the state as color value.
+ */
+static inline double sample_value(int32_t sample) {
+  return sample * (1. / (1 << FIXED_STATE_BITS));
+}
+
+/**
+ * @brief Returns the threshold in the units of the state.
+ */
+static inline double state_threshold(double threshold, double) {
+  return threshold;
+}
+
+/**
+ * @brief Returns the threshold in the units of the fixed-point state, a
+ * sample is on if it is at least the returned value.
+ */
+static inline int32_t state_threshold(double threshold, int32_t) {
+  return (int32_t)std::ceil(threshold * (1 << FIXED_STATE_BITS));
+}
+
+/**
+ * @brief Returns the quantization error of a sample.
+ */
+static inline double sample_error(double sample, BYTE color) {
+  return sample - color;
+}
+
+/**
+ * @brief Returns the quantization error of a fixed-point sample.
+ */
+static inline int32_t sample_error(int32_t sample, BYTE color) {
+  return sample - ((int32_t)color << FIXED_STATE_BITS);
+}
+
+/**
+ * @brief Returns the share numerator / denominator of an error.
+ */
+static inline double diffused(double error, int numerator, int denominator) {
+  return error * ((double)numerator / denominator);
+}
+
+/**
+ * @brief Returns the share numerator / denominator of a fixed-point error,
+ * as a multiply with the rounded weight and a rounding shift.
+ */
+static inline int32_t diffused(int32_t error, int numerator, int denominator) {
+  const int32_t weight =
+      ((numerator << FIXED_WEIGHT_BITS) + denominator / 2) / denominator;
+  // MBVQ errors can grow to thousands of levels, whose products with the
+  // weight overflow 32 bits
+  return ((int64_t)error * weight + (1 << (FIXED_WEIGHT_BITS - 1))) >>
+         FIXED_WEIGHT_BITS;
+}
+
+/**
+ * @brief Returns the share of an error given to a tap loaded at runtime.
+ */
+static inline double diffused(double error, const KERNEL_TAP &tap, int) {
+  return error * tap.weight;
+}
+
+/**
+ * @brief Returns the share of a fixed-point error given to a tap loaded at
+ * runtime.
+ */
+static inline int32_t diffused(int32_t error, const KERNEL_TAP &tap, int) {
+  return ((int64_t)error * tap.fixed_weight +
+          (1 << (FIXED_WEIGHT_BITS - 1))) >>
+         FIXED_WEIGHT_BITS;
+}
+
+/**
+ * @struct LANES
+ * @brief The samples of a pixel with three channels, padded to four lanes
+ * so that all channels share one operation per tap.
+ *
+ * The generic version loops over the lanes, the specializations below keep
+ * the lanes in one SIMD register when the instruction set is available.
+ */
+template <typename STATE> struct LANES {
+  STATE v[4];
+
+  static LANES load(const STATE *p) {
+    return {{p[0], p[1], p[2], p[3]}};
+  }
+
+  void store(STATE *p) const {
+    for (int k = 0; k < 4; ++k) {
+      p[k] = this->v[k];
     }
-    if (G > 0.5) {
-      if (G >= B) {
-        if (G >= R) {
-          vertex = COLOR::GREEN;
-        }
-      }
+  }
+
+  LANES operator+(const LANES &other) const {
+    LANES sum;
+    for (int k = 0; k < 4; ++k) {
+      sum.v[k] = this->v[k] + other.v[k];
     }
-    if (R > 0.5) {
-      if (R >= B) {
-        if (R >= G) {
-          vertex = COLOR::RED;
-        }
-      }
+    return sum;
+  }
+
+  // bit ch is set if channel ch is at least threshold
+  int on(STATE threshold) const {
+    return (this->v[0] >= threshold) | (this->v[1] >= threshold) << 1 |
+           (this->v[2] >= threshold) << 2;
+  }
+
+  // quantization error for the channels given by the bits of on
+  LANES error(int on) const {
+    LANES error;
+    for (int k = 0; k < 4; ++k) {
+      error.v[k] = sample_error(this->v[k], on >> k & 1 ? 255 : 0);
     }
+    return error;
   }
 
-  if (mbvq == MBVQ::RGBM) {
-    vertex = COLOR::GREEN;
-    if (R > G) {
-      if (R >= B) {
-        if (B < 0.5) {
-          vertex = COLOR::RED;
-        } else {
-          vertex = COLOR::MAGENTA;
-        }
-      }
+  template <typename WEIGHT>
+  LANES diffused(const WEIGHT &weight, int denominator) const {
+    LANES share;
+    for (int k = 0; k < 4; ++k) {
+      share.v[k] = ::diffused(this->v[k], weight, denominator);
     }
-    if (B > G) {
-      if (B >= R) {
-        if (R < 0.5) {
-          vertex = COLOR::BLUE;
-        } else {
-          vertex = COLOR::MAGENTA;
-        }
-      }
+    return share;
+  }
+};
+
+#if defined(__AVX__)
+/**
+ * @brief Four double lanes in an AVX register.
+ */
+template <> struct LANES<double> {
+  __m256d v;
+
+  static LANES load(const double *p) { return {_mm256_loadu_pd(p)}; }
+
+  void store(double *p) const { _mm256_storeu_pd(p, this->v); }
+
+  LANES operator+(const LANES &other) const {
+    return {_mm256_add_pd(this->v, other.v)};
+  }
+
+  int on(double threshold) const {
+    return _mm256_movemask_pd(
+               _mm256_cmp_pd(this->v, _mm256_set1_pd(threshold), _CMP_GE_OQ)) &
+           7;
+  }
+
+  LANES error(int on) const {
+    alignas(32) static const double COLORS[8][4] = {
+        {0, 0, 0, 0},       {255, 0, 0, 0},     {0, 255, 0, 0},
+        {255, 255, 0, 0},   {0, 0, 255, 0},     {255, 0, 255, 0},
+        {0, 255, 255, 0},   {255, 255, 255, 0}};
+    return {_mm256_sub_pd(this->v, _mm256_load_pd(COLORS[on]))};
+  }
+
+  LANES diffused(int numerator, int denominator) const {
+    return {_mm256_mul_pd(this->v,
+                          _mm256_set1_pd((double)numerator / denominator))};
+  }
+
+  LANES diffused(const KERNEL_TAP &tap, int) const {
+    return {_mm256_mul_pd(this->v, _mm256_set1_pd(tap.weight))};
+  }
+};
+#endif
+
+#if defined(__SSE4_1__)
+/**
+ * @brief Four fixed-point lanes in a SSE register.
+ */
+template <> struct LANES<int32_t> {
+  __m128i v;
+
+  static LANES load(const int32_t *p) {
+    return {_mm_loadu_si128((const __m128i *)p)};
+  }
+
+  void store(int32_t *p) const { _mm_storeu_si128((__m128i *)p, this->v); }
+
+  LANES operator+(const LANES &other) const {
+    return {_mm_add_epi32(this->v, other.v)};
+  }
+
+  int on(int32_t threshold) const {
+    // a lane is off if the threshold is greater
+    const __m128i off = _mm_cmpgt_epi32(_mm_set1_epi32(threshold), this->v);
+    return ~_mm_movemask_ps(_mm_castsi128_ps(off)) & 7;
+  }
+
+  LANES error(int on) const {
+    const int32_t ON = 255 << FIXED_STATE_BITS;
+    alignas(16) static const int32_t COLORS[8][4] = {
+        {0, 0, 0, 0},       {ON, 0, 0, 0},      {0, ON, 0, 0},
+        {ON, ON, 0, 0},     {0, 0, ON, 0},      {ON, 0, ON, 0},
+        {0, ON, ON, 0},     {ON, ON, ON, 0}};
+    return {_mm_sub_epi32(this->v, _mm_load_si128((const __m128i *)COLORS[on]))};
+  }
+
+  LANES diffused(int numerator, int denominator) const {
+    return this->diffused(
+        ((numerator << FIXED_WEIGHT_BITS) + denominator / 2) / denominator);
+  }
+
+  LANES diffused(const KERNEL_TAP &tap, int) const {
+    return this->diffused(tap.fixed_weight);
+  }
+
+  // multiply with a weight of FIXED_WEIGHT_BITS and a rounding shift
+  LANES diffused(int32_t weight) const {
+    const __m128i w = _mm_set1_epi32(weight);
+    const __m128i half = _mm_set1_epi32(1 << (FIXED_WEIGHT_BITS - 1));
+    // errors of 2048 levels and more, which only MBVQ reaches, overflow a
+    // 32-bit product and take 64 bits like the scalar version
+    const __m128i large = _mm_cmpgt_epi32(
+        _mm_abs_epi32(this->v),
+        _mm_set1_epi32((1 << (31 - FIXED_WEIGHT_BITS)) - 1));
+    if (!_mm_movemask_epi8(large)) {
+      return {_mm_srai_epi32(
+          _mm_add_epi32(_mm_mullo_epi32(this->v, w), half),
+          FIXED_WEIGHT_BITS)};
     }
+    // lanes 0 and 2, then lanes 1 and 3, the shares are the low halves of
+    // the 64-bit results, which a logical shift gets right
+    const __m128i half64 = _mm_cvtepi32_epi64(half);
+    const __m128i even = _mm_srli_epi64(
+        _mm_add_epi64(_mm_mul_epi32(this->v, w), half64), FIXED_WEIGHT_BITS);
+    const __m128i odd = _mm_srli_epi64(
+        _mm_add_epi64(_mm_mul_epi32(_mm_srli_epi64(this->v, 32), w), half64),
+        FIXED_WEIGHT_BITS);
+    return {_mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC)};
   }
+};
+#endif
 
-  if (mbvq == MBVQ::CMGB) {
-    if (B > 0.5) {
-      if (R > 0.5) {
-        if (G >= R) {
-          vertex = COLOR::CYAN;
-        } else {
-          vertex = COLOR::MAGENTA;
-        }
-      } else {
-        if (G > 0.5) {
-          vertex = COLOR::CYAN;
-        } else {
-          vertex = COLOR::BLUE;
-        }
-      }
-    } else {
-      if (R > 0.5) {
-        if (R - G + B >= 0.5) {
-          vertex = COLOR::MAGENTA;
-        } else {
-          vertex = COLOR::GREEN;
-        }
-      } else {
-        if (G >= B) {
-          vertex = COLOR::GREEN;
-        } else {
-          vertex = COLOR::BLUE;
-        }
+/**
+ * @brief Quantizes column y of the next row and diffuses its error to the
+ * rows in target. Taps are bounds checked only when CHECKED.
+ * @param image Image receiving the row.
+ * @param i Row index in image.
+ * @param target Ring rows from the next row down to the last row reached.
+ * @param rows Number of rows below the next row that exist.
+ * @param y Column index.
+ * @param threshold Threshold in the units of the state.
+ */
+template <typename TAPS, int DIR, typename STATE, bool CHECKED>
+void ErrorDiffuser::_pixel(Image &image, uint i, const TAPS &taps,
+                          STATE *const *target, int rows, int y,
+                          STATE threshold) {
+  const int width = this->_width, channels = this->_channels;
+  const STATE *pixel = target[0] + (size_t)y * channels;
+  for (int ch = 0; ch < channels; ++ch) {
+    const BYTE value = pixel[ch] >= threshold ? 255 : 0;
+    image.row(i, this->_first + ch)[(size_t)y * image.step()] = value;
+    const STATE error = sample_error(pixel[ch], value);
+    taps.apply([&](int r, int c, const auto &weight) {
+      const int newY = y + DIR * c;
+      if (!CHECKED || (r <= rows && newY >= 0 && newY < width)) {
+        STATE &val = target[r][newY * channels + ch];
+        val = val + diffused(error, weight, taps.denominator);
       }
-    }
+    });
   }
-  return vertex;
 }
 
 /**
- * @brief Determines the MBVQ type based on the given RGB values.
- * 
- * @param R Red component of the color.
- * @param G Green component of the color.
- * @param B Blue component of the color.
- * @return MBVQ The MBVQ type corresponding to the RGB values.
+ * @brief Quantizes column y of the next row of a three channel image and
+ * diffuses the error of all channels at once. Taps are bounds checked only
+ * when CHECKED.
+ * @param image Image receiving the row.
+ * @param i Row index in image.
+ * @param target Ring rows from the next row down to the last row reached.
+ * @param rows Number of rows below the next row that exist.
+ * @param y Column index.
+ * @param threshold Threshold in the units of the state.
  */
-MBVQ get_mbvq(BYTE R, BYTE G, BYTE B) {
-  MBVQ res;
-  if (R + G > 255) {
-    if (G + B > 255) {
-      if (R + G + B > 510) {
-        res = MBVQ::CMYW;
-      } else {
-        res = MBVQ::MYGC;
-      }
-    } else {
-      res = MBVQ::RGMY;
-    }
+template <typename TAPS, int DIR, typename STATE, bool CHECKED>
+void ErrorDiffuser::_lanes_pixel(Image &image, uint i, const TAPS &taps,
+                                 STATE *const *target, int rows, int y,
+                                 STATE threshold) {
+  const int width = this->_width;
+  const LANES<STATE> pixel = LANES<STATE>::load(target[0] + (size_t)y * 4);
+  int on;
+  if (this->_isMBVQ) {
+    const STATE *sample = target[0] + (size_t)y * 4;
+    const double rgb[3] = {sample_value(sample[0]), sample_value(sample[1]),
+                           sample_value(sample[2])};
+    const uint32_t color = get_mbvq_color(rgb);
+    on = (color & 1) | (color >> 7 & 2) | (color >> 14 & 4);
   } else {
-    if (~(G + B > 255)) {
-      if (~(R + G + B > 255)) {
-        res = MBVQ::KRGB;
-      } else {
-        res = MBVQ::RGBM;
-      }
-    } else {
-      res = MBVQ::CMGB;
+    on = pixel.on(threshold);
+  }
+  for (int ch = 0; ch < 3; ++ch) {
+    image.row(i, this->_first + ch)[(size_t)y * image.step()] =
+        on >> ch & 1 ? 255 : 0;
+  }
+  const LANES<STATE> error = pixel.error(on);
+  taps.apply([&](int r, int c, const auto &weight) {
+    const int newY = y + DIR * c;
+    if (!CHECKED || (r <= rows && newY >= 0 && newY < width)) {
+      STATE *val = target[r] + (size_t)newY * 4;
+      (LANES<STATE>::load(val) + error.diffused(weight, taps.denominator))
+          .store(val);
     }
+  });
+}
+
+/**
+ * @brief Diffuses the next row with state of type STATE, scanning left to
+ * right when DIR is 1 and right to left with mirrored taps when DIR is -1.
+ * @param image Image receiving the row.
+ * @param i Row index in image.
+ * @param taps Taps of the kernel.
+ */
+template <typename TAPS, int DIR, typename STATE, bool PACKED>
+void ErrorDiffuser::_diffuse_row(Image &image, uint i, const TAPS &taps) {
+  const int si = taps.rows;
+  const int width = this->_width;
+  // rows above x are already popped, errors diffused there cannot change
+  // the result, so only the rows x to x + si are reached
+  const int rows = std::min<int>(si, this->_height - 1 - this->_popped);
+  STATE *target[KERNEL_MAX_ROWS + 1];
+  for (int r = 0; r <= rows; ++r) {
+    target[r] = this->_row<STATE>(this->_popped + r);
+  }
+  // every tap of the columns lo to hi lands inside the image, unless the
+  // kernel reaches below the last row, mirrored taps swap left and right
+  const int left = DIR > 0 ? taps.left : taps.right;
+  const int right = DIR > 0 ? taps.right : taps.left;
+  const int lo = rows == si ? left : width, hi = width - 1 - right;
+  const int begin = DIR > 0 ? 0 : width - 1, end = DIR > 0 ? width - 1 : 0;
+  const STATE threshold = state_threshold(this->_threshold, STATE());
+  int y = begin;
+  for (; y != end && (y < lo || y > hi); y += DIR) {
+    PACKED ? this->_lanes_pixel<TAPS, DIR, STATE, true>(image, i, taps, target,
+                                                        rows, y, threshold)
+           : this->_pixel<TAPS, DIR, STATE, true>(image, i, taps, target, rows,
+                                                  y, threshold);
+  }
+  for (; y != end && y >= lo && y <= hi; y += DIR) {
+    PACKED ? this->_lanes_pixel<TAPS, DIR, STATE, false>(image, i, taps, target,
+                                                         rows, y, threshold)
+           : this->_pixel<TAPS, DIR, STATE, false>(image, i, taps, target,
+                                                   rows, y, threshold);
+  }
+  for (; y != end; y += DIR) {
+    PACKED ? this->_lanes_pixel<TAPS, DIR, STATE, true>(image, i, taps, target,
+                                                        rows, y, threshold)
+           : this->_pixel<TAPS, DIR, STATE, true>(image, i, taps, target, rows,
+                                                  y, threshold);
+  }
+  // the last column of the scan is never visited and stays black
+  for (size_t ch = 0; ch < this->_channels; ++ch) {
+    image.row(i, this->_first + ch)[end * image.step()] = 0;
   }
-  return res;
 }
 
 /**
- * @brief Retrieves the color for a specific pixel in the 3D matrix based on a threshold.
- * 
- * @param ip_crate 3D matrix containing color data.
- * @param x X-coordinate of the pixel.
- * @param y Y-coordinate of the pixel.
- * @param threshold Threshold for deciding pixel color.
- * @return VECTOR_BYTE Vector containing the RGB values for the pixel.
+ * @brief Diffuses the next row with the taps of TAPS and state of type STATE.
+ * @param image Image receiving the row.
+ * @param i Row index in image.
+ * @param taps Taps of the kernel.
+ * @param reverse Whether the row is scanned right to left.
  */
-VECTOR_BYTE get_color(VECTOR_DOUBLE_3D &ip_crate, uint x, uint y,
-                      double threshold) {
-  VECTOR_BYTE color(ip_crate[0][0].size());
-  for (size_t ch = 0; ch < ip_crate[0][0].size(); ++ch) {
-    color[ch] = ip_crate[x][y][ch] >= threshold ? 255 : 0;
+template <typename TAPS, typename STATE>
+void ErrorDiffuser::_diffuse_state(Image &image, uint i, const TAPS &taps,
+                                   bool reverse) {
+  // three channels are diffused together in the lanes of one pixel
+  if (this->_stride == 4) {
+    reverse ? this->_diffuse_row<TAPS, -1, STATE, true>(image, i, taps)
+            : this->_diffuse_row<TAPS, 1, STATE, true>(image, i, taps);
+  } else {
+    reverse ? this->_diffuse_row<TAPS, -1, STATE, false>(image, i, taps)
+            : this->_diffuse_row<TAPS, 1, STATE, false>(image, i, taps);
   }
-  return color;
 }
 
 /**
- * @brief Retrieves the color for a specific pixel in the 3D matrix based on MBVQ technique.
- * 
- * @param ip_crate 3D matrix containing color data.
- * @param x X-coordinate of the pixel.
- * @param y Y-coordinate of the pixel.
- * @return VECTOR_BYTE Vector containing the RGB values for the pixel.
+ * @brief Diffuses the next row with the taps of TAPS.
+ * @param image Image receiving the row.
+ * @param i Row index in image.
+ * @param taps Taps of the kernel.
  */
-VECTOR_BYTE get_mbvq_color(const VECTOR_DOUBLE_3D &ip_crate, uint x, uint y) {
-  const MBVQ mbvq =
-      get_mbvq(ip_crate[x][y][0], ip_crate[x][y][1], ip_crate[x][y][2]);
-  const COLOR vertex =
-      get_nearest_vertex(mbvq, ip_crate[x][y][0] / 255.,
-                         ip_crate[x][y][1] / 255., ip_crate[x][y][2] / 255.);
+template <typename TAPS>
+void ErrorDiffuser::_diffuse(Image &image, uint i, const TAPS &taps) {
+  // error-diffusion is like convolution but changes direction
+  // eg. for the first row it moves from right to left (mirrored taps)
+  // and for the next row it moves from left to right
+  const bool reverse = this->_popped % 2 == 0;
+  if (this->_fixed) {
+    this->_diffuse_state<TAPS, int32_t>(image, i, taps, reverse);
+  } else {
+    this->_diffuse_state<TAPS, double>(image, i, taps, reverse);
+  }
+}
 
-  unsigned char R = 0, G = 0, B = 0;
+/**
+ * @brief Diffuses the next row and writes its halftone.
+ * @param image Image receiving the row, may be the pushed image.
+ * @param i Row index in image.
+ */
+void ErrorDiffuser::pop(Image &image, uint i) {
+  assert(this->ready());
+  switch (this->_kernel_type) {
+  case FLOYD_STEINBERG:
+    this->_diffuse(image, i, KERNEL_TAPS<FLOYD_STEINBERG>());
+    break;
+  case JARVIS_JUDICE_NINKE:
+    this->_diffuse(image, i, KERNEL_TAPS<JARVIS_JUDICE_NINKE>());
+    break;
+  case STUCKI:
+    this->_diffuse(image, i, KERNEL_TAPS<STUCKI>());
+    break;
+  case CUSTOM:
+    this->_diffuse(image, i, this->_custom);
+    break;
+  }
+  this->_popped++;
+}
 
-  if (vertex == COLOR::RED || vertex == COLOR::MAGENTA ||
-      vertex == COLOR::YELLOW || vertex == COLOR::WHITE) {
-    R = 255;
+/**
+ * @brief Diffuses the next row and writes its halftone as bits.
+ * @param bits Image receiving the row.
+ * @param i Row index in bits.
+ */
+void ErrorDiffuser::pop(BitImage &bits, uint i) {
+  assert(this->_first == 0 && bits.channels() == this->_channels);
+  // the row is diffused into one reused row of samples and packed, so the
+  // output of a whole image is only 1/8 of its samples
+  if (this->_line.width() != this->_width ||
+      this->_line.layout() != bits.layout()) {
+    this->_line = Image(this->_width, 1, this->_channels, bits.layout());
   }
+  this->pop(this->_line, 0);
+  bits.pack_row(i, this->_line, 0);
+}
 
-  if (vertex == COLOR::GREEN || vertex == COLOR::CYAN ||
-      vertex == COLOR::YELLOW || vertex == COLOR::WHITE) {
-    G = 255;
+/**
+ * @brief Diffuses every channel of an INTERLEAVED image in place on its own
+ * thread, a band of DIFFUSION_BAND_ROWS rows at a time.
+ * @param image Image to be processed, overwritten with the result.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param make_diffuser Returns the ErrorDiffuser of a channel group.
+ */
+template <typename MAKE>
+static void diffuse_channels(Image &image, uint threads, MAKE make_diffuser) {
+  assert(image.layout() == INTERLEAVED);
+  // the samples of a pixel share a cache line, so every thread writes its
+  // halftone to a plane of the band and the band is interleaved once all
+  // channels have finished it
+  const uint channels = image.channels();
+  Image band(image.width(), std::min(DIFFUSION_BAND_ROWS, image.height()),
+             channels, PLANAR);
+  std::vector<ErrorDiffuser> diffusers;
+  for (uint k = 0; k < channels; ++k) {
+    diffusers.push_back(make_diffuser(1, k));
+  }
+  std::vector<uint> pushed(channels, 0);
+  for (uint first = 0; first < image.height(); first += band.height()) {
+    const uint last = std::min(first + band.height(), image.height());
+    parallel_for(channels, threads, [&](uint k) {
+      // rows are only overwritten after the band, so the rows read ahead
+      // by the kernel still hold their input
+      ErrorDiffuser &diffuser = diffusers[k];
+      for (uint done = first; done < last;) {
+        if (diffuser.ready()) {
+          diffuser.pop(band, done++ - first);
+        } else {
+          diffuser.push(image, pushed[k]++);
+        }
+      }
+    });
+    for (uint i = first; i < last; ++i) {
+      BYTE *dst = image.row(i);
+      for (uint k = 0; k < channels; ++k) {
+        const BYTE *src = band.row(i - first, k);
+        for (size_t j = 0; j < image.width(); ++j) {
+          dst[j * channels + k] = src[j];
+        }
+      }
+    }
   }
+}
 
-  if (vertex == COLOR::BLUE || vertex == COLOR::CYAN ||
-      vertex == COLOR::MAGENTA || vertex == COLOR::WHITE) {
-    B = 255;
+/**
+ * @brief Diffuses an image in place with the diffusers made by make_diffuser
+ * for a number of channels and the first channel.
+ * @param image Image to be processed, overwritten with the result.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param make_diffuser Returns the ErrorDiffuser of a channel group.
+ */
+template <typename MAKE>
+static void diffuse_inplace(Image &image, bool isMBVQ, uint threads,
+                            MAKE make_diffuser) {
+  assert(isMBVQ && image.channels() == 3 || !isMBVQ);
+  // without MBVQ every channel is an independent grayscale diffusion
+  const bool split =
+      !isMBVQ && image.channels() > 1 && thread_count(threads) > 1;
+  if (split && image.layout() == INTERLEAVED) {
+    diffuse_channels(image, threads, make_diffuser);
+    return;
   }
-  return {R, G, B};
+  const uint groups = split ? image.channels() : 1;
+  const uint channels = split ? 1 : image.channels();
+  parallel_for(groups, threads, [&](uint group) {
+    // a row is overwritten with its halftone once every row the kernel
+    // reaches from it has been read into the ring of the diffuser
+    ErrorDiffuser diffuser = make_diffuser(channels, group);
+    for (uint x = 0, done = 0; x < image.height(); ++x) {
+      diffuser.push(image, x);
+      while (diffuser.ready()) {
+        diffuser.pop(image, done++);
+      }
+    }
+  });
 }
 
 /**
- * @brief Flips the 2D kernel matrix horizontally (left-to-right).
+ * @brief Performs error diffusion on the provided image in place.
  * 
- * @param kernel 2D matrix representing the kernel.
- * @return VECTOR_DOUBLE_2D Flipped kernel.
- */
-VECTOR_DOUBLE_2D fliplr(VECTOR_DOUBLE_2D kernel) {
-  assert(kernel.size() == kernel[0].size() && kernel.size() % 2 == 1);
-  const size_t rows = kernel.size(), cols = kernel[0].size();
-  for (size_t i = 0; i < cols / 2; ++i) {
-    for (size_t j = 0; j < rows; ++j) {
-      std::swap(kernel[j][i], kernel[j][cols - 1 - i]);
+ * @param image Image to be processed, overwritten with the result.
+ * @param kernel_type Type of diffusion kernel to be used.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param fixed Use fixed-point integer arithmetic instead of doubles.
+ */
+void error_diffusion_inplace(Image &image, DIFFUSION_KERNEL kernel_type,
+                             bool isMBVQ, double threshold, uint threads,
+                             bool fixed) {
+  diffuse_inplace(image, isMBVQ, threads, [&](uint channels, uint group) {
+    return ErrorDiffuser(image.width(), image.height(), channels, kernel_type,
+                         isMBVQ, threshold, group, fixed);
+  });
+}
+
+/**
+ * @brief Performs error diffusion on the provided image in place with a
+ * kernel loaded at runtime.
+ *
+ * @param image Image to be processed, overwritten with the result.
+ * @param kernel Taps of the kernel.
+ * @param isMBVQ Flag to determine if MBVQ technique is used.
+ * @param threshold Threshold for the error diffusion.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param fixed Use fixed-point integer arithmetic instead of doubles.
+ */
+void error_diffusion_inplace(Image &image, const CUSTOM_KERNEL &kernel,
+                             bool isMBVQ, double threshold, uint threads,
+                             bool fixed) {
+  diffuse_inplace(image, isMBVQ, threads, [&](uint channels, uint group) {
+    return ErrorDiffuser(image.width(), image.height(), channels, kernel,
+                         isMBVQ, threshold, group, fixed);
+  });
+}
+
+/**
+ * @brief Loads a diffusion kernel from a text file.
+ * @param filename Path to the kernel file.
+ */
+CUSTOM_KERNEL load_kernel(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    throw std::invalid_argument("Could not open kernel " + filename);
+  }
+  CUSTOM_KERNEL kernel;
+  std::vector<std::pair<KERNEL_TAP, int>> taps; // taps with their numerator
+  int divisor = 0, origin = -1, row = -1;
+  // a row may hold any number of taps of up to 65535 each
+  int64_t total = 0;
+  std::string line;
+  for (uint number = 1; std::getline(file, line); number++) {
+    const std::string where = filename + ":" + std::to_string(number) + ": ";
+    std::istringstream stream(line);
+    std::vector<std::string> tokens;
+    for (std::string token; stream >> token;) {
+      tokens.push_back(token);
+    }
+    if (tokens.empty() || tokens[0][0] == '#') {
+      continue;
+    }
+    // parses a non-negative integer token, -1 if it is none
+    auto parse = [](const std::string &token) {
+      size_t parsed = 0;
+      long value = -1;
+      try {
+        value = std::stol(token, &parsed);
+      } catch (const std::exception &) {
+        parsed = 0;
+      }
+      return parsed == token.size() && value >= 0 && value <= 65535
+                 ? (int)value
+                 : -1;
+    };
+    if (tokens[0] == "divisor") {
+      if (tokens.size() != 2 || row >= 0 || divisor ||
+          (divisor = parse(tokens[1])) <= 0) {
+        throw std::invalid_argument(
+            where + "Expected `divisor <1-65535>` before the matrix");
+      }
+      continue;
+    }
+    if (row < 0) {
+      const auto x = std::find(tokens.begin(), tokens.end(), "X");
+      if (x == tokens.end()) {
+        throw std::invalid_argument(where + "The first row must hold `X`");
+      }
+      origin = x - tokens.begin();
+    }
+    if (++row > KERNEL_MAX_ROWS) {
+      throw std::invalid_argument(where + "The kernel reaches more than " +
+                                  std::to_string(KERNEL_MAX_ROWS) +
+                                  " rows below the pixel");
+    }
+    for (int col = 0; col < (int)tokens.size(); ++col) {
+      const std::string &token = tokens[col];
+      if (token == "-" || (row == 0 && col == origin)) {
+        continue;
+      }
+      const int numerator = parse(token);
+      if (numerator < 0) {
+        throw std::invalid_argument(where + "Invalid weight `" + token +
+                                    "`; Expected `X`, `-` or an integer");
+      }
+      if (numerator > 0 && row == 0 && col < origin) {
+        throw std::invalid_argument(
+            where + "Taps left of `X` reach pixels that are already quantized");
+      }
+      if (numerator > 0) {
+        taps.push_back({{row, col - origin, 0, 0}, numerator});
+        total += numerator;
+      }
     }
   }
+  if (taps.empty()) {
+    throw std::invalid_argument(filename + ": The kernel has no taps");
+  }
+  if (total > 65535) {
+    throw std::invalid_argument(filename + ": The weights add up to " +
+                                std::to_string(total) +
+                                ", more than 65535");
+  }
+  divisor = divisor ? divisor : total;
+  if (total > divisor) {
+    throw std::invalid_argument(filename + ": The weights add up to " +
+                                std::to_string(total) + "/" +
+                                std::to_string(divisor) +
+                                ", more than 1");
+  }
+  // the weights are converted once, the same way as the built-in kernels.
+  // Rounding may push their fixed-point sum past 1, which makes the error
+  // grow without bound
+  int fixed_total = 0;
+  for (auto &[tap, numerator] : taps) {
+    tap.fixed_weight =
+        ((numerator << FIXED_WEIGHT_BITS) + divisor / 2) / divisor;
+    fixed_total += tap.fixed_weight;
+  }
+  if (fixed_total > 1 << FIXED_WEIGHT_BITS) {
+    throw std::invalid_argument(
+        filename + ": The weights add up to more than 1 when rounded to 1/" +
+        std::to_string(1 << FIXED_WEIGHT_BITS));
+  }
+  kernel.denominator = divisor;
+  for (auto &[tap, numerator] : taps) {
+    tap.weight = (double)numerator / divisor;
+    kernel.rows = std::max(kernel.rows, tap.row);
+    kernel.left = std::max(kernel.left, -tap.col);
+    kernel.right = std::max(kernel.right, tap.col);
+    kernel.taps.push_back(tap);
+  }
   return kernel;
 }
 
@@ -347,61 +915,6 @@ VECTOR_DOUBLE_2D fliplr(VECTOR_DOUBLE_2D kernel) {
  */
 Image error_diffusion(Image image, DIFFUSION_KERNEL kernel_type,
                       bool isMBVQ = false, double threshold = 127.) {
-  assert(isMBVQ && image.channels() == 3 || !isMBVQ);
-  VECTOR_DOUBLE_2D kernel = DIFFUSION_KERNELS[kernel_type];
-  const int si = kernel.size() / 2;
-  Image ret = image.like();
-  VECTOR_DOUBLE_3D ip_crate(
-      image.height(),
-      VECTOR_DOUBLE_2D(image.width(), std::vector<double>(image.channels())));
-  for (size_t i = 0; i < image.height(); ++i) {
-    for (size_t j = 0; j < image.width(); ++j) {
-      for (size_t ch = 0; ch < image.channels(); ++ch) {
-        ip_crate[i][j][ch] = (double)image.get(i, j, ch);
-      }
-    }
-  }
-  for (size_t x = 0; x < image.height(); ++x) {
-    size_t begin, end;
-    int inc;
-    VECTOR_DOUBLE_2D curr_kernel;
-    // error-diffusion is like convolution but changes direction
-    // eg. for the first row it moves from right to left (flipped kernel)
-    // and for the next row it moves from left to right (non-flipped kernel)
-    if (x % 2 == 0) {
-      begin = image.width() - 1;
-      end = 0;
-      inc = -1;
-      curr_kernel = fliplr(kernel);
-    } else {
-      begin = 0;
-      end = image.width() - 1;
-      inc = 1;
-      curr_kernel = kernel;
-    }
-    for (size_t y = begin; y != end; y += inc) {
-      VECTOR_BYTE color;
-      if (isMBVQ) {
-        color = get_mbvq_color(ip_crate, x, y);
-      } else {
-        color = get_color(ip_crate, x, y, threshold);
-      }
-      for (size_t ch = 0; ch < image.channels(); ++ch) {
-        ret.set(x, y, ch, color[ch]);
-        double error = ip_crate[x][y][ch] - ret.get(x, y, ch);
-        for (int i = -1 * si; i <= si; ++i) {
-          for (int j = -1 * si; j <= si; ++j) {
-            int newX = x + i, newY = y + j;
-            bool inside = newX >= 0 && newY >= 0 && newX < image.height() &&
-                          newY < image.width();
-            if (inside) {
-              ip_crate[newX][newY][ch] = ip_crate[newX][newY][ch] +
-                                         error * curr_kernel[i + si][j + si];
-            }
-          }
-        }
-      }
-    }
-  }
-  return ret;
+  error_diffusion_inplace(image, kernel_type, isMBVQ, threshold);
+  return image;
 }
@@ -0,0 +1,471 @@
+#include "jpeg.h"
+#include "Image.h"
+#include "simd.h"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#include <jerror.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+typedef unsigned int uint;
+
+// Number of scanlines handed to libjpeg per read/write call
+static const uint JPEG_BATCH_ROWS = 16;
+
+/**
+ * @brief libjpeg error handler that returns to the setjmp of the running
+ * entry point instead of exiting the process.
+ * @param cinfo libjpeg state that raised the error, its err is a
+ *              JPEG_ERROR_MGR.
+ */
+static void jump_error(j_common_ptr cinfo) {
+  JPEG_ERROR_MGR *err = (JPEG_ERROR_MGR *)cinfo->err;
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->jump, 1);
+}
+
+/**
+ * @brief Checks the denominator of a scaled decode.
+ * @param scale Denominator of the decoded size.
+ */
+static void check_scale(uint scale) {
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+    throw std::invalid_argument("JPG images can be decoded at 1/1, 1/2, 1/4 "
+                                "or 1/8 of their size");
+  }
+}
+
+/**
+ * @brief Closes a file opened by a reader or writer, the standard streams
+ * are only flushed.
+ * @param file The file.
+ */
+static void close_file(FILE *file) {
+  if (file == stdin || file == stdout) {
+    fflush(file);
+  } else {
+    fclose(file);
+  }
+}
+
+/**
+ * @brief Default constructor.
+ */
+JpegReader::JpegReader()
+    : _file_src(nullptr), _memory_src(nullptr), _file(nullptr),
+      _started(false), _luma(false) {
+  this->_cinfo.err = jpeg_std_error(&this->_jerr.mgr);
+  this->_jerr.mgr.error_exit = jump_error;
+  jpeg_create_decompress(&this->_cinfo);
+}
+
+/**
+ * @brief Destructor, releases the decoder and closes the file.
+ */
+JpegReader::~JpegReader() {
+  jpeg_destroy_decompress(&this->_cinfo);
+  if (this->_file) {
+    close_file(this->_file);
+  }
+}
+
+/**
+ * @brief Opens a JPG file and reads its header.
+ * @param filename Path to the JPG image.
+ * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale.
+ */
+bool JpegReader::open(const std::string &filename, uint scale, bool fast_dct,
+                      bool gray) {
+  check_scale(scale);
+  this->_file = filename == "-" ? stdin : fopen(filename.c_str(), "rb");
+  if (!this->_file) {
+    std::cerr << "[Error] Could not open file " << filename << std::endl;
+    return false;
+  }
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  // libjpeg refuses to replace a source of another kind, so every kind is
+  // created once and swapped in
+  this->_cinfo.src = this->_file_src;
+  jpeg_stdio_src(&this->_cinfo, this->_file);
+  this->_file_src = this->_cinfo.src;
+  this->_start(scale, fast_dct, gray);
+  return true;
+}
+
+/**
+ * @brief Opens a JPG held in memory and reads its header.
+ * @param data The JPG data.
+ * @param size Size of the JPG data in bytes.
+ * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale.
+ */
+void JpegReader::open(const BYTE *data, size_t size, uint scale,
+                      bool fast_dct, bool gray) {
+  check_scale(scale);
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  this->_cinfo.src = this->_memory_src;
+  jpeg_mem_src(&this->_cinfo, data, size);
+  this->_memory_src = this->_cinfo.src;
+  this->_start(scale, fast_dct, gray);
+}
+
+/**
+ * @brief Reads the header from the source and starts decompression. Errors
+ * return to the setjmp of open().
+ * @param scale Denominator of the decoded size: 1, 2, 4 or 8.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale.
+ */
+void JpegReader::_start(uint scale, bool fast_dct, bool gray) {
+  jpeg_read_header(&this->_cinfo, TRUE);
+  // reading the header resets the decompression parameters
+  this->_cinfo.scale_num = 1;
+  this->_cinfo.scale_denom = scale;
+  this->_cinfo.dct_method = fast_dct ? JDCT_IFAST : JDCT_ISLOW;
+  // libjpeg outputs the Y component and skips the chroma entirely
+  this->_luma = gray && this->_cinfo.jpeg_color_space == JCS_YCbCr;
+  if (this->_luma) {
+    this->_cinfo.out_color_space = JCS_GRAYSCALE;
+  }
+  jpeg_start_decompress(&this->_cinfo);
+  this->_started = true;
+}
+
+/**
+ * @brief Aborts decoding after a libjpeg error, closes the file and throws
+ * the error.
+ */
+void JpegReader::_fail() {
+  this->_started = false;
+  jpeg_abort_decompress(&this->_cinfo);
+  if (this->_file) {
+    close_file(this->_file);
+    this->_file = nullptr;
+  }
+  throw std::runtime_error(this->_jerr.message);
+}
+
+/**
+ * @brief Returns the width of the decoded image.
+ */
+uint JpegReader::width() const { return this->_cinfo.output_width; }
+
+/**
+ * @brief Returns the height of the decoded image.
+ */
+uint JpegReader::height() const { return this->_cinfo.output_height; }
+
+/**
+ * @brief Returns the number of channels of the decoded image.
+ */
+uint JpegReader::channels() const { return this->_cinfo.output_components; }
+
+/**
+ * @brief Returns the index of the next row to be decoded.
+ */
+uint JpegReader::scanline() const { return this->_cinfo.output_scanline; }
+
+/**
+ * @brief Decodes the next rows into rows [first, first + rows) of an image.
+ * @param image Destination with the width and channels of the JPG.
+ * @param first First destination row.
+ * @param rows Number of rows to decode.
+ */
+uint JpegReader::read(Image &image, uint first, uint rows) {
+  const bool planar = image.layout() == PLANAR;
+  const size_t span = (size_t)image.width() * image.channels();
+  std::vector<BYTE> &scratch = this->_scratch;
+  if (planar) {
+    scratch.resize(span * JPEG_BATCH_ROWS);
+  }
+  JSAMPROW rowPointers[JPEG_BATCH_ROWS];
+  uint done = 0;
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  while (done < rows && this->scanline() < this->height()) {
+    const uint count = std::min(JPEG_BATCH_ROWS, rows - done);
+    for (uint r = 0; r < count; r++) {
+      rowPointers[r] =
+          planar ? &scratch[r * span] : image.row(first + done + r);
+    }
+    // libjpeg may return fewer rows than requested
+    const uint read = jpeg_read_scanlines(&this->_cinfo, rowPointers, count);
+    for (uint r = 0; this->_luma && r < read; r++) {
+      luma_to_gray(rowPointers[r], rowPointers[r], image.width());
+    }
+    if (planar) {
+      for (uint r = 0; r < read; r++) {
+        for (uint k = 0; k < image.channels(); k++) {
+          BYTE *dst = image.row(first + done + r, k);
+          for (uint j = 0; j < image.width(); j++) {
+            dst[j] = scratch[r * span + j * image.channels() + k];
+          }
+        }
+      }
+    }
+    done += read;
+  }
+  return done;
+}
+
+/**
+ * @brief Finishes decoding and closes the file.
+ */
+void JpegReader::close() {
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  // a failed finish leaves _started unset, closing again aborts
+  const bool complete = this->_started && this->scanline() == this->height();
+  this->_started = false;
+  if (complete) {
+    jpeg_finish_decompress(&this->_cinfo);
+  } else {
+    jpeg_abort_decompress(&this->_cinfo);
+  }
+  if (this->_file) {
+    close_file(this->_file);
+    this->_file = nullptr;
+  }
+}
+
+/**
+ * @brief Starts a buffer destination, the whole capacity of the buffer is
+ * handed to libjpeg.
+ * @param cinfo libjpeg state, its client_data is the buffer.
+ */
+static void init_buffer(j_compress_ptr cinfo) {
+  std::vector<BYTE> &buffer = *(std::vector<BYTE> *)cinfo->client_data;
+  try {
+    buffer.resize(std::max<size_t>(buffer.capacity(), 1 << 16));
+  } catch (const std::bad_alloc &) {
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  }
+  cinfo->dest->next_output_byte = buffer.data();
+  cinfo->dest->free_in_buffer = buffer.size();
+}
+
+/**
+ * @brief Doubles a full buffer destination.
+ * @param cinfo libjpeg state, its client_data is the buffer.
+ * @return TRUE, the buffer never suspends.
+ */
+static boolean grow_buffer(j_compress_ptr cinfo) {
+  std::vector<BYTE> &buffer = *(std::vector<BYTE> *)cinfo->client_data;
+  // libjpeg calls this with the whole buffer used
+  const size_t used = buffer.size();
+  try {
+    buffer.resize(2 * used);
+  } catch (const std::bad_alloc &) {
+    // like the errors of libjpeg, must not unwind through it
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  }
+  cinfo->dest->next_output_byte = buffer.data() + used;
+  cinfo->dest->free_in_buffer = buffer.size() - used;
+  return TRUE;
+}
+
+/**
+ * @brief Trims a buffer destination to the encoded JPG.
+ * @param cinfo libjpeg state, its client_data is the buffer.
+ */
+static void term_buffer(j_compress_ptr cinfo) {
+  std::vector<BYTE> &buffer = *(std::vector<BYTE> *)cinfo->client_data;
+  buffer.resize(buffer.size() - cinfo->dest->free_in_buffer);
+}
+
+/**
+ * @brief Default constructor.
+ */
+JpegWriter::JpegWriter()
+    : _file_dest(nullptr), _buffer(nullptr), _file(nullptr), _started(false) {
+  this->_cinfo.err = jpeg_std_error(&this->_jerr.mgr);
+  this->_jerr.mgr.error_exit = jump_error;
+  jpeg_create_compress(&this->_cinfo);
+  this->_buffer_dest.init_destination = init_buffer;
+  this->_buffer_dest.empty_output_buffer = grow_buffer;
+  this->_buffer_dest.term_destination = term_buffer;
+}
+
+/**
+ * @brief Destructor, releases the encoder and closes the file.
+ */
+JpegWriter::~JpegWriter() {
+  jpeg_destroy_compress(&this->_cinfo);
+  if (this->_file) {
+    close_file(this->_file);
+  }
+}
+
+/**
+ * @brief Creates a JPG file and starts compression.
+ * @param filename Path to save the JPG image.
+ * @param width Image width.
+ * @param height Image height.
+ * @param quality Quality of the saved JPG image.
+ * @param channels Channels of the JPG: 1 for grayscale or 3 for RGB.
+ * @param restart_rows Rows of MCUs between restart markers, 0 for none.
+ */
+bool JpegWriter::open(const std::string &filename, uint width, uint height,
+                      int quality, uint channels, uint restart_rows) {
+  this->_file = filename == "-" ? stdout : fopen(filename.c_str(), "wb");
+  if (!this->_file) {
+    std::cerr << "[Error] Could not open file " << filename << std::endl;
+    return false;
+  }
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  // like the sources of JpegReader, the file destination is created once
+  this->_cinfo.dest = this->_file_dest;
+  jpeg_stdio_dest(&this->_cinfo, this->_file);
+  this->_file_dest = this->_cinfo.dest;
+  this->_start(width, height, quality, channels, restart_rows);
+  return true;
+}
+
+/**
+ * @brief Starts compression into a buffer.
+ * @param buffer Buffer receiving the JPG.
+ * @param width Image width.
+ * @param height Image height.
+ * @param quality Quality of the JPG image.
+ * @param channels Channels of the JPG: 1 for grayscale or 3 for RGB.
+ * @param restart_rows Rows of MCUs between restart markers, 0 for none.
+ */
+void JpegWriter::open(std::vector<BYTE> &buffer, uint width, uint height,
+                      int quality, uint channels, uint restart_rows) {
+  this->_buffer = &buffer;
+  this->_cinfo.client_data = &buffer;
+  this->_cinfo.dest = &this->_buffer_dest;
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  this->_start(width, height, quality, channels, restart_rows);
+}
+
+/**
+ * @brief Sets the parameters of the JPG and starts compression. Errors
+ * return to the setjmp of open().
+ * @param width Image width.
+ * @param height Image height.
+ * @param quality Quality of the JPG image.
+ * @param channels Channels of the JPG: 1 for grayscale or 3 for RGB.
+ * @param restart_rows Rows of MCUs between restart markers, 0 for none.
+ */
+void JpegWriter::_start(uint width, uint height, int quality, uint channels,
+                        uint restart_rows) {
+  this->_cinfo.image_width = width;
+  this->_cinfo.image_height = height;
+  this->_cinfo.input_components = channels == 1 ? 1 : 3;
+  this->_cinfo.in_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_set_defaults(&this->_cinfo);
+  jpeg_set_quality(&this->_cinfo, quality, TRUE);
+  // the defaults clear the restart interval, so it is set after them
+  this->_cinfo.restart_in_rows = restart_rows;
+  jpeg_start_compress(&this->_cinfo, TRUE);
+  this->_started = true;
+}
+
+/**
+ * @brief Aborts encoding after a libjpeg error, empties the buffer, closes
+ * the file and throws the error.
+ */
+void JpegWriter::_fail() {
+  this->_started = false;
+  jpeg_abort_compress(&this->_cinfo);
+  if (this->_buffer) {
+    this->_buffer->clear();
+    this->_buffer = nullptr;
+  }
+  if (this->_file) {
+    close_file(this->_file);
+    this->_file = nullptr;
+  }
+  throw std::runtime_error(this->_jerr.message);
+}
+
+/**
+ * @brief Returns the index of the next row to be encoded.
+ */
+uint JpegWriter::scanline() const { return this->_cinfo.next_scanline; }
+
+/**
+ * @brief Encodes rows [first, first + rows) of an image as the next rows.
+ * @param image Source with the width of the JPG.
+ * @param first First source row.
+ * @param rows Number of rows to encode.
+ */
+void JpegWriter::write(const Image &image, uint first, uint rows) {
+  const uint channels = this->_cinfo.input_components;
+  // a single channel is contiguous in both layouts
+  const bool direct = image.channels() == channels &&
+                      (channels == 1 || image.layout() == INTERLEAVED);
+  const size_t span = (size_t)image.width() * channels;
+  std::vector<BYTE> &scratch = this->_scratch;
+  if (!direct) {
+    scratch.resize(span * JPEG_BATCH_ROWS);
+  }
+  JSAMPROW rowPointers[JPEG_BATCH_ROWS];
+  uint done = 0;
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  while (done < rows) {
+    const uint count = std::min(JPEG_BATCH_ROWS, rows - done);
+    for (uint r = 0; r < count; r++) {
+      if (direct) {
+        // libjpeg does not modify the rows it is given
+        rowPointers[r] = const_cast<BYTE *>(image.row(first + done + r));
+        continue;
+      }
+      rowPointers[r] = &scratch[r * span];
+      for (uint k = 0; k < channels; k++) {
+        const BYTE *src =
+            image.row(first + done + r, image.channels() == 1 ? 0 : k);
+        for (uint j = 0; j < image.width(); j++) {
+          scratch[r * span + j * channels + k] = src[j * image.step()];
+        }
+      }
+    }
+    done += jpeg_write_scanlines(&this->_cinfo, rowPointers, count);
+  }
+}
+
+/**
+ * @brief Finishes compression and closes the file.
+ */
+void JpegWriter::close() {
+  if (setjmp(this->_jerr.jump)) {
+    this->_fail();
+  }
+  // a failed finish leaves _started unset, closing again aborts
+  const bool complete =
+      this->_started && this->scanline() == this->_cinfo.image_height;
+  this->_started = false;
+  if (complete) {
+    jpeg_finish_compress(&this->_cinfo);
+  } else {
+    jpeg_abort_compress(&this->_cinfo);
+    if (this->_buffer) {
+      this->_buffer->clear();
+    }
+  }
+  this->_buffer = nullptr;
+  if (this->_file) {
+    close_file(this->_file);
+    this->_file = nullptr;
+  }
+}
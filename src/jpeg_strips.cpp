@@ -0,0 +1,282 @@
+#include "jpeg_strips.h"
+#include "Image.h"
+#include "jpeg.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+typedef unsigned int uint;
+
+/**
+ * @struct JPEG_SCAN
+ * @brief Layout of a baseline JPG with a single scan.
+ */
+struct JPEG_SCAN {
+  size_t sof = 0;     ///< Offset of the image height in the SOF segment.
+  size_t data = 0;    ///< Offset of the entropy coded data.
+  size_t end = 0;     ///< Offset of the EOI marker.
+  uint width = 0;     ///< Image width.
+  uint height = 0;    ///< Image height.
+  uint mcu_width = 0; ///< Width of an MCU in pixels.
+  uint mcu_height = 0; ///< Height of an MCU in pixels.
+  uint restart = 0;   ///< Restart interval in MCUs, 0 for none.
+  std::vector<size_t> markers; ///< Offsets of the restart markers.
+};
+
+/**
+ * @brief Parses the markers of a JPG.
+ * @param data The JPG data.
+ * @param size Size of the JPG data in bytes.
+ * @param scan Receives the layout.
+ * @return Whether the JPG is baseline (or extended sequential Huffman) with
+ * one scan of all components, a known height and a restart interval. The
+ * entropy coded data is only searched for restart markers once the header
+ * qualifies.
+ */
+static bool parse_scan(const BYTE *data, size_t size, JPEG_SCAN &scan) {
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+    return false;
+  }
+  uint components = 0, hmax = 1, vmax = 1;
+  size_t pos = 2;
+  while (true) {
+    if (pos + 4 > size || data[pos] != 0xFF) {
+      return false;
+    }
+    const BYTE marker = data[pos + 1];
+    if (marker == 0xFF) {
+      // fill byte before a marker
+      pos++;
+      continue;
+    }
+    const size_t length = data[pos + 2] << 8 | data[pos + 3];
+    if (length < 2 || pos + 2 + length > size) {
+      return false;
+    }
+    if (marker == 0xC0 || marker == 0xC1) {
+      components = length >= 8 ? data[pos + 9] : 0;
+      if (components == 0 || length < 8 + 3 * components) {
+        return false;
+      }
+      scan.sof = pos + 5;
+      scan.height = data[pos + 5] << 8 | data[pos + 6];
+      scan.width = data[pos + 7] << 8 | data[pos + 8];
+      for (uint c = 0; c < components; c++) {
+        const BYTE sampling = data[pos + 11 + 3 * c];
+        hmax = std::max<uint>(hmax, sampling >> 4);
+        vmax = std::max<uint>(vmax, sampling & 15);
+      }
+    } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 &&
+               marker != 0xC8 && marker != 0xCC) {
+      // progressive, lossless, hierarchical or arithmetic coded
+      return false;
+    } else if (marker == 0xDD && length >= 4) {
+      scan.restart = data[pos + 4] << 8 | data[pos + 5];
+    } else if (marker == 0xDA) {
+      if (!scan.sof || data[pos + 4] != components) {
+        return false;
+      }
+      scan.data = pos + 2 + length;
+      break;
+    }
+    pos += 2 + length;
+  }
+  if (scan.restart == 0) {
+    return false;
+  }
+  // a scan of one component has MCUs of one block
+  scan.mcu_width = components == 1 ? 8 : 8 * hmax;
+  scan.mcu_height = components == 1 ? 8 : 8 * vmax;
+  scan.markers.clear();
+  for (pos = scan.data; pos + 1 < size; pos++) {
+    if (data[pos] != 0xFF || data[pos + 1] == 0x00 || data[pos + 1] == 0xFF) {
+      // entropy coded byte, stuffed 0xFF or fill byte
+      pos += data[pos] == 0xFF && data[pos + 1] == 0x00;
+      continue;
+    }
+    if (data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7) {
+      scan.markers.push_back(pos++);
+      continue;
+    }
+    scan.end = pos;
+    // anything but EOI, e.g. a second scan or DNL, is not supported
+    return data[pos + 1] == 0xD9 && scan.height > 0;
+  }
+  return false;
+}
+
+/**
+ * @brief Writes the height of a JPG into its SOF segment.
+ * @param jpg The JPG data.
+ * @param sof Offset of the height in the SOF segment.
+ * @param height The height.
+ */
+static void patch_height(BYTE *jpg, size_t sof, uint height) {
+  jpg[sof] = height >> 8;
+  jpg[sof + 1] = height & 0xFF;
+}
+
+/**
+ * @brief Encodes an image in horizontal strips, in parallel, and hands the
+ * pieces of the stitched JPG in order to put. Every strip is released once
+ * it is put.
+ * @param image The image.
+ * @param quality Quality of the JPG image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @param put Called with the data and size of every piece.
+ */
+template <typename PUT>
+static void encode_strips(const Image &image, int quality, uint threads,
+                          PUT put) {
+  const uint channels = image.channels() == 1 ? 1 : 3;
+  // libjpeg subsamples the chroma of color JPGs 2x2 by default
+  const uint mcu_height = channels == 1 ? 8 : 16;
+  const uint rows = JPEG_STRIP_MCU_ROWS * mcu_height;
+  const uint strips = std::max(1u, (image.height() + rows - 1) / rows);
+  std::vector<std::vector<BYTE>> buffers(strips);
+  parallel_for(strips, thread_count(threads), [&](uint s) {
+    const uint first = s * rows;
+    const uint count = std::min(rows, image.height() - first);
+    JpegWriter writer;
+    writer.open(buffers[s], image.width(), count, quality, channels, 1);
+    writer.write(image, first, count);
+    writer.close();
+  });
+  // the first strip keeps its header with the height of the image, the
+  // others only add their entropy coded data after a restart marker, RST7
+  // since every strip has a multiple of 8 intervals
+  static const BYTE RST7[2] = {0xFF, 0xD7}, EOI[2] = {0xFF, 0xD9};
+  for (uint s = 0; s < strips; s++) {
+    std::vector<BYTE> &strip = buffers[s];
+    JPEG_SCAN scan;
+    if (!parse_scan(strip.data(), strip.size(), scan) ||
+        scan.mcu_height != mcu_height) {
+      throw std::runtime_error("Unexpected layout of an encoded JPG strip");
+    }
+    if (s == 0) {
+      patch_height(strip.data(), scan.sof, image.height());
+      put(strip.data(), scan.end);
+    } else {
+      put(RST7, 2);
+      put(strip.data() + scan.data, scan.end - scan.data);
+    }
+    std::vector<BYTE>().swap(strip);
+  }
+  put(EOI, 2);
+}
+
+/**
+ * @brief Encodes an image into a baseline JPG in horizontal strips, in
+ * parallel.
+ * @param image The image.
+ * @param jpg Receives the JPG.
+ * @param quality Quality of the JPG image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+void write_jpg_strips(const Image &image, std::vector<BYTE> &jpg, int quality,
+                      uint threads) {
+  jpg.clear();
+  encode_strips(image, quality, threads, [&](const BYTE *data, size_t size) {
+    jpg.insert(jpg.end(), data, data + size);
+  });
+}
+
+/**
+ * @brief Encodes an image into a baseline JPG in horizontal strips, in
+ * parallel, and writes it to a file.
+ * @param image The image.
+ * @param file The opened output file.
+ * @param quality Quality of the JPG image.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ * @return bool False if writing to the file failed.
+ */
+bool write_jpg_strips(const Image &image, FILE *file, int quality,
+                      uint threads) {
+  bool written = true;
+  encode_strips(image, quality, threads, [&](const BYTE *data, size_t size) {
+    written = written && fwrite(data, 1, size, file) == size;
+  });
+  return written;
+}
+
+/**
+ * @brief Decodes a JPG with restart markers in horizontal strips, in
+ * parallel.
+ * @param data The JPG data.
+ * @param size Size of the JPG data in bytes.
+ * @param image Destination, already sized for the decoded JPG.
+ * @param scale Denominator of the decoded size.
+ * @param fast_dct Use the fast integer IDCT.
+ * @param gray Decode color images as grayscale.
+ * @param threads Number of threads, 0 for one per hardware thread.
+ */
+bool read_jpg_strips(const BYTE *data, size_t size, Image &image, uint scale,
+                     bool fast_dct, bool gray, uint threads) {
+  threads = thread_count(threads);
+  JPEG_SCAN scan;
+  if (threads < 2 || !parse_scan(data, size, scan)) {
+    return false;
+  }
+  const size_t mcus = (scan.width + scan.mcu_width - 1) / scan.mcu_width;
+  const uint mcu_rows = (scan.height + scan.mcu_height - 1) / scan.mcu_height;
+  const size_t intervals = (mcus * mcu_rows + scan.restart - 1) / scan.restart;
+  if (scan.markers.size() + 1 != intervals) {
+    return false;
+  }
+  // strips start where an interval starts on a row of MCUs, every unit
+  // rows of MCUs
+  const size_t unit = std::lcm<size_t>(scan.restart, mcus) / mcus;
+  const size_t units = (mcu_rows + unit - 1) / unit;
+  const uint strips = std::min<size_t>(threads, units);
+  if (strips < 2) {
+    return false;
+  }
+  parallel_for(strips, threads, [&](uint s) {
+    // rows of MCUs [r0, r1) are kept, [a, b) are decoded
+    const size_t r0 = s * units / strips * unit;
+    const size_t r1 = std::min<size_t>((s + 1) * units / strips * unit,
+                                       mcu_rows);
+    const size_t a = r0 > 0 ? r0 - unit : 0;
+    const size_t b = std::min<size_t>(r1 + unit, mcu_rows);
+    const size_t first = a * mcus / scan.restart;
+    const size_t last = (b * mcus + scan.restart - 1) / scan.restart;
+    // header with the height of the strip, its intervals with the restart
+    // markers renumbered from RST0, and EOI
+    std::vector<BYTE> strip(data, data + scan.data);
+    patch_height(strip.data(), scan.sof,
+                 std::min<size_t>(b * scan.mcu_height, scan.height) -
+                     a * scan.mcu_height);
+    size_t start = first == 0 ? scan.data : scan.markers[first - 1] + 2;
+    for (size_t m = first; m + 1 < last; m++) {
+      strip.insert(strip.end(), data + start, data + scan.markers[m]);
+      strip.push_back(0xFF);
+      strip.push_back(0xD0 + (m - first) % 8);
+      start = scan.markers[m] + 2;
+    }
+    const size_t stop = last == intervals ? scan.end : scan.markers[last - 1];
+    strip.insert(strip.end(), data + start, data + stop);
+    strip.push_back(0xFF);
+    strip.push_back(0xD9);
+
+    JpegReader reader;
+    reader.open(strip.data(), strip.size(), scale, fast_dct, gray);
+    // rows of MCUs are a multiple of 8 pixels high, so they scale exactly
+    const uint skip = (r0 - a) * scan.mcu_height / scale;
+    const uint top = r0 * scan.mcu_height / scale;
+    const uint bottom =
+        (std::min<size_t>(r1 * scan.mcu_height, scan.height) + scale - 1) /
+        scale;
+    if (skip > 0) {
+      Image context(reader.width(), skip, reader.channels(), image.layout());
+      reader.read(context, 0, skip);
+    }
+    if (reader.read(image, top, bottom - top) != bottom - top) {
+      throw std::runtime_error("Truncated JPG strip");
+    }
+    reader.close();
+  });
+  return true;
+}
@@ -1,10 +1,21 @@
+#include "BitImage.h"
 #include "Image.h"
+#include "batch.h"
+#include "bilevel.h"
+#include "blue_noise.h"
 #include "dithering.h"
 #include "error_diffusion.h"
+#include "pipeline.h"
 #include <boost/program_options.hpp>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/stat.h>
 #include <vector>
 
 typedef unsigned int unit;
@@ -48,20 +59,50 @@ void validate_argument(const std::string &type, const uint &value,
  */
 void parse_arguments(int argc, char **argv, po::variables_map &vm,
                      po::options_description &desc) {
-  desc.add_options()("help", "help message")("input", po::value<std::string>(),
-                                             "input image path (only jpg)")(
-      "output", po::value<std::string>(), "output image path (only jpg)")(
+  desc.add_options()("help", "help message")(
+      "input", po::value<std::string>(),
+      "input image path (only jpg), - for the standard input")(
+      "output", po::value<std::string>(),
+      "output image path (jpg, or bit-packed pbm / pam), - for the standard "
+      "output (jpg)")(
       "op", po::value<uint>(),
       "operation to perform DITHERING=1 / ERROR_DIFFUSION=2")(
       "bw", po::value<bool>(), "convert image to black and white (default 0)")(
+      "scale", po::value<uint>(),
+      "decode the input at 1/scale of its size, 1 / 2 / 4 / 8 (default 1)")(
+      "fast-dct", po::value<bool>(),
+      "decode with the faster, less accurate integer IDCT (default 0)")(
       "size", po::value<uint>(),
       "dimension of dithering matrix for DITHERING (default 8)")(
+      "mask", po::value<uint>(),
+      "threshold mask for DITHERING BAYER=1 / BLUE_NOISE=2 (default 1)")(
+      "mask-cache", po::value<std::string>(),
+      "blue-noise mask cache file (default "
+      "~/.cache/image_print/blue_noise_<size>.bin)")(
       "kernel", po::value<uint>(),
       "FLOYD_STEINBERG=1 / JARVIS_JUDICE_NINKE=2 / STUCKI=3 (default 2)")(
-      "threshold", po::value<uint>(),
-      "threshold for ERROR_DIFFUSION (default 127)")(
+      "kernel-file", po::value<std::string>(),
+      "diffusion kernel loaded from a text file, replaces `kernel`")(
+      "threshold", po::value<std::string>(),
+      "threshold for ERROR_DIFFUSION, 0-255 or auto (Otsu) (default 127)")(
       "mbvq", po::value<bool>(),
-      "use MBVQ technique for ERROR_DIFFUSION (default 0)");
+      "use MBVQ technique for ERROR_DIFFUSION (default 0)")(
+      "fixed", po::value<bool>(),
+      "use fixed-point arithmetic for ERROR_DIFFUSION (default 0)")(
+      "brightness", po::value<int>(),
+      "value added to every sample before processing (default 0)")(
+      "contrast", po::value<int>(),
+      "factor every sample is multiplied with before processing (default 1)")(
+      "stream", po::value<bool>(),
+      "stream rows from input to output with bounded memory (default 0)")(
+      "threads", po::value<uint>(),
+      "number of threads, 0 for one per core (default 1)")(
+      "batch", po::value<std::string>(),
+      "directory of jpg images or manifest file to process, `output` is the "
+      "output directory for a directory")(
+      "jobs", po::value<uint>(),
+      "number of images processed at once with `batch`, 0 for one per core "
+      "(default 0)");
   try {
     po::store(po::parse_command_line(argc, argv, desc), vm);
     po::notify(vm);
@@ -70,7 +111,215 @@ void parse_arguments(int argc, char **argv, po::variables_map &vm,
   }
 }
 
+/**
+ * Returns a blue-noise mask, generated or read from its cache file only the
+ * first time a dimension and cache file are used, so that the pipelines of
+ * all manifest lines share it.
+ * @param size: Dimension of the mask.
+ * @param cache: Path of the cache file.
+ * @return The threshold matrix.
+ */
+std::shared_ptr<const mCRATE> load_mask(uint size, const std::string &cache) {
+  static std::map<std::pair<uint, std::string>, std::shared_ptr<const mCRATE>>
+      masks;
+  std::shared_ptr<const mCRATE> &mask = masks[{size, cache}];
+  if (!mask) {
+    mask = std::make_shared<const mCRATE>(blue_noise_matrix(size, cache));
+  }
+  return mask;
+}
+
+/**
+ * Builds the pipeline described by parsed arguments.
+ * @param vm: Variables map holding the parsed arguments.
+ * @return The pipeline, `op` has to be given.
+ * @throws std::invalid_argument if an argument is missing or invalid.
+ */
+PIPELINE make_pipeline(const po::variables_map &vm) {
+  if (!vm.count("op")) {
+    throw std::invalid_argument("Argument `op` is required");
+  }
+  uint op = vm["op"].as<uint>();
+  validate_argument("op", op, {1, 2});
+  PIPELINE pipeline;
+  pipeline.op = static_cast<OPERATION>(op);
+  // downsized decode in the DCT domain
+  pipeline.scale = vm.count("scale") ? vm["scale"].as<uint>() : 1;
+  validate_argument("scale", pipeline.scale, {1, 2, 4, 8});
+  pipeline.fast_dct = vm.count("fast-dct") && vm["fast-dct"].as<bool>();
+  // if bw convert image to black and white
+  pipeline.bw = vm.count("bw") && vm["bw"].as<bool>() == true;
+  // brightness and contrast pre-processing
+  pipeline.brightness =
+      vm.count("brightness") ? vm["brightness"].as<int>() : 0;
+  pipeline.contrast = vm.count("contrast") ? vm["contrast"].as<int>() : 1;
+  pipeline.threads = vm.count("threads") ? vm["threads"].as<uint>() : 1;
+  // process operations
+  if (op == 1) {
+    uint size = vm.count("size") ? vm["size"].as<uint>() : 8;
+    // check if dimension of the dithering matrix is in power of 2
+    if (!(size >= 2 && size <= BAYER_MAX_DIM && (size & (size - 1)) == 0)) {
+      throw std::invalid_argument(
+          "Invalid value for argument `size`; Should be in powers of 2 from "
+          "2 to " + std::to_string(BAYER_MAX_DIM));
+    }
+    pipeline.size = size;
+    uint mask = vm.count("mask") ? vm["mask"].as<uint>() : 1;
+    validate_argument("mask", mask, {1, 2});
+    if (mask == 2) {
+      pipeline.mask = load_mask(
+          size, vm.count("mask-cache") ? vm["mask-cache"].as<std::string>()
+                                       : blue_noise_cache(size));
+    }
+  } else {
+    uint kernel_idx = vm.count("kernel") ? vm["kernel"].as<uint>() : 2;
+    std::string threshold_arg =
+        vm.count("threshold") ? vm["threshold"].as<std::string>() : "127";
+    bool is_mbvq = vm.count("mbvq") && vm["mbvq"].as<bool>() ? true : false;
+    validate_argument("kernel", kernel_idx, {1, 2, 3});
+    if (threshold_arg == "auto") {
+      pipeline.auto_threshold = true;
+    } else {
+      uint threshold = 0;
+      size_t parsed = 0;
+      try {
+        threshold = std::stoul(threshold_arg, &parsed);
+      } catch (const std::exception &) {
+        parsed = 0;
+      }
+      if (parsed != threshold_arg.size() || threshold > 255) {
+        throw std::invalid_argument(
+            "Argument `threshold` should be within 0 and 255 or auto");
+      }
+      pipeline.threshold = threshold;
+    }
+    pipeline.kernel = static_cast<DIFFUSION_KERNEL>(kernel_idx);
+    if (vm.count("kernel-file")) {
+      pipeline.kernel = CUSTOM;
+      pipeline.custom = load_kernel(vm["kernel-file"].as<std::string>());
+    }
+    pipeline.isMBVQ = is_mbvq;
+    pipeline.fixed = vm.count("fixed") && vm["fixed"].as<bool>() == true;
+  }
+  return pipeline;
+}
+
+/**
+ * Collects the jobs of a batch run. A directory gives one job per jpg image
+ * with the output in the `output` directory. A manifest gives one job per
+ * line `<input> <output> [options]`, where the options override the ones of
+ * the command line; empty lines and lines starting with `#` are skipped.
+ * Options a line cannot change, the files and how the batch runs, make the
+ * line invalid.
+ * @param argc: Argument count.
+ * @param argv: Argument vector.
+ * @param vm: Variables map holding the parsed arguments.
+ * @param desc: Description of allowed options.
+ * @param invalid: Incremented for every manifest line that is reported as
+ *                 invalid and skipped.
+ * @return The jobs in order.
+ */
+std::vector<BATCH_JOB> batch_jobs(int argc, char **argv,
+                                  const po::variables_map &vm,
+                                  const po::options_description &desc,
+                                  uint &invalid) {
+  const std::string batch = vm["batch"].as<std::string>();
+  std::vector<BATCH_JOB> jobs;
+  struct stat info;
+  if (stat(batch.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+    if (!vm.count("output")) {
+      throw std::invalid_argument("Argument `output` is required");
+    }
+    const PIPELINE pipeline = make_pipeline(vm);
+    const std::string output = vm["output"].as<std::string>();
+    for (const std::string &name : list_images(batch)) {
+      jobs.push_back({batch + "/" + name, output + "/" + name, pipeline});
+    }
+    return jobs;
+  }
+  std::ifstream manifest(batch);
+  if (!manifest) {
+    throw std::invalid_argument("Could not open manifest " + batch);
+  }
+  std::string line;
+  for (uint number = 1; std::getline(manifest, line); number++) {
+    std::istringstream stream(line);
+    std::vector<std::string> tokens((std::istream_iterator<std::string>(stream)),
+                                    std::istream_iterator<std::string>());
+    if (tokens.empty() || tokens[0][0] == '#') {
+      continue;
+    }
+    try {
+      if (tokens.size() < 2) {
+        throw std::invalid_argument("Expected `<input> <output> [options]`");
+      }
+      if (tokens[0] == "-" || tokens[1] == "-") {
+        throw std::invalid_argument(
+            "The standard input and output are not supported with `batch`");
+      }
+      // the options of the line are stored first and take precedence
+      const po::parsed_options options =
+          po::command_line_parser(
+              std::vector<std::string>(tokens.begin() + 2, tokens.end()))
+              .options(desc)
+              .run();
+      for (const po::option &option : options.options) {
+        // the line gives the files, the batch runs images in parallel
+        for (const char *name :
+             {"input", "output", "stream", "threads", "batch", "jobs"}) {
+          if (option.string_key == name) {
+            throw std::invalid_argument("Argument `" + option.string_key +
+                                        "` is not supported in a manifest");
+          }
+        }
+      }
+      po::variables_map line_vm;
+      po::store(options, line_vm);
+      po::store(po::parse_command_line(argc, argv, desc), line_vm);
+      po::notify(line_vm);
+      jobs.push_back({tokens[0], tokens[1], make_pipeline(line_vm)});
+    } catch (const std::exception &e) {
+      cerr(batch + ":" + std::to_string(number) + ": " + e.what());
+      invalid++;
+    }
+  }
+  return jobs;
+}
+
+/**
+ * Runs a batch and prints its throughput.
+ * @param argc: Argument count.
+ * @param argv: Argument vector.
+ * @param vm: Variables map holding the parsed arguments.
+ * @param desc: Description of allowed options.
+ * @return Exit code, 1 if any image failed.
+ */
+int run_batch(int argc, char **argv, const po::variables_map &vm,
+              const po::options_description &desc) {
+  if (vm.count("stream") && vm["stream"].as<bool>()) {
+    throw std::invalid_argument(
+        "Argument `stream` is not supported with `batch`");
+  }
+  if (vm.count("threads") && vm["threads"].as<uint>() != 1) {
+    throw std::invalid_argument(
+        "Argument `threads` is not supported with `batch`, use `jobs`");
+  }
+  uint invalid = 0;
+  const std::vector<BATCH_JOB> jobs = batch_jobs(argc, argv, vm, desc, invalid);
+  const uint workers = vm.count("jobs") ? vm["jobs"].as<uint>() : 0;
+  BATCH_REPORT report = process_batch(jobs, workers);
+  report.failures += invalid;
+  std::cout << "Processed " << report.images << " images, "
+            << report.failures << " failed, in " << report.seconds << " s ("
+            << report.images / report.seconds << " images/s, "
+            << report.pixels / report.seconds / 1e6 << " MPixel/s)"
+            << std::endl;
+  return report.failures ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
+  // the output is written to a partial file until it is complete
+  std::string output_file, partial;
   try {
     // parse CLI arguments
     po::variables_map vm;
@@ -88,49 +337,59 @@ int main(int argc, char *argv[]) {
       usage = "./image_print --input=<input-image-path> "
               "--output=<output-image-path> --op=DITHERING --size=16 --bw=1";
       std::cout << usage << std::endl;
+      usage = "./image_print --input=<input-image-path> "
+              "--output=<output-image-path>.pbm --op=2 --bw=1";
+      std::cout << usage << std::endl;
+      usage = "cat <input-image-path> | ./image_print --input=- --output=- "
+              "--op=1 --bw=1 > <output-image-path>";
+      std::cout << usage << std::endl;
+      usage = "./image_print --batch=<input-directory> "
+              "--output=<output-directory> --op=1 --jobs=4";
+      std::cout << usage << std::endl;
       return 0;
     }
+    if (vm.count("batch")) {
+      return run_batch(argc, argv, vm, desc);
+    }
     // validate necessary arguments
     if (!vm.count("input") || !vm.count("output") || !vm.count("op")) {
       throw std::invalid_argument(
           "Arguments `input`, `output` and `op` are required");
     }
     std::string input_file = vm["input"].as<std::string>();
-    std::string output_file = vm["output"].as<std::string>();
-    uint op = vm["op"].as<uint>();
-    validate_argument("op", op, {1, 2});
-    // create and load image
+    output_file = vm["output"].as<std::string>();
+    PIPELINE pipeline = make_pipeline(vm);
+    bool stream = vm.count("stream") && vm["stream"].as<bool>() == true;
+    if (stream) {
+      return process_stream(input_file, output_file, pipeline) ? 0 : 1;
+    }
+    // create and load image, the reader reports a missing file
     Image image;
-    image.readJpg(input_file);
-    // if bw convert image to black and white
-    bool bw = vm.count("bw") && vm["bw"].as<bool>() == true;
-    if (bw) {
-      image = image.rgb_2_gray();
-    }
-    // process operations
-    if (op == 1) {
-      uint size = vm.count("size") ? vm["size"].as<uint>() : 8;
-      // check if dimension of the dithering matrix is in power of 2
-      if (!(size > 0 && (size & (size - 1)) == 0)) {
-        cerr("Invalid value for argument `size`; Should be in powers of 2");
-        return 1;
-      }
-      image = dithering(image, size);
+    if (!image.readJpg(input_file, pipeline.scale, pipeline.fast_dct,
+                       pipeline.bw, pipeline.threads)) {
+      return 1;
+    }
+    const OUTPUT_FORMAT format = output_format(output_file);
+    bool written;
+    if (format == JPG) {
+      process(image, pipeline);
+      partial = partial_output(output_file);
+      written = image.writeJpg(partial, 75, pipeline.threads);
     } else {
-      uint kernel_idx = vm.count("kernel") ? vm["kernel"].as<uint>() : 2;
-      uint threshold = vm.count("threshold") ? vm["threshold"].as<uint>() : 127;
-      bool is_mbvq = vm.count("mbvq") && vm["mbvq"].as<bool>() ? true : false;
-      validate_argument("kernel", kernel_idx, {1, 2, 3});
-      if (threshold < 0 || threshold > 255) {
-        throw std::invalid_argument(
-            "Argument `threshold` should be within 0 and 255");
-      }
-      DIFFUSION_KERNEL kernel = static_cast<DIFFUSION_KERNEL>(kernel_idx);
-      image = error_diffusion(image, kernel, is_mbvq, threshold);
+      BitImage bits;
+      process(image, bits, pipeline);
+      partial = partial_output(output_file);
+      written = write_bilevel(bits, partial, format);
+    }
+    finish_output(partial, output_file, written);
+    if (!written) {
+      return 1;
     }
-    image.writeJpg(output_file);
   } catch (const std::exception &e) {
     cerr(e.what());
+    if (!partial.empty()) {
+      finish_output(partial, output_file, false);
+    }
     return 1;
   }
   return 0;
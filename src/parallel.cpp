@@ -0,0 +1,67 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef unsigned int uint;
+
+/**
+ * @brief Returns the number of threads to use for a requested count,
+ * 0 meaning one per hardware thread.
+ * @param threads Requested number of threads.
+ */
+uint thread_count(uint threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return threads;
+}
+
+/**
+ * @brief Runs task(0) ... task(tasks - 1) on up to `threads` threads.
+ * @param tasks Number of tasks.
+ * @param threads Maximum number of threads, including the calling one.
+ * @param task Function called with the index of each task.
+ */
+void parallel_for(uint tasks, uint threads,
+                  const std::function<void(uint)> &task) {
+  threads = std::min(thread_count(threads), tasks);
+  if (threads <= 1) {
+    for (uint t = 0; t < tasks; t++) {
+      task(t);
+    }
+    return;
+  }
+  std::atomic<uint> next(0);
+  std::mutex mutex;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    for (uint t = next++; t < tasks; t = next++) {
+      try {
+        task(t);
+      } catch (...) {
+        // keep the first failure and stop handing out tasks
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = tasks;
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (uint n = 1; n < threads; n++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,217 @@
+#include "pipeline.h"
+#include "BitImage.h"
+#include "Image.h"
+#include "bilevel.h"
+#include "dithering.h"
+#include "error_diffusion.h"
+#include "jpeg.h"
+#include "statistics.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+typedef unsigned int uint;
+
+// Number of rows decoded and processed at once when streaming
+static const uint STREAM_BATCH_ROWS = 16;
+
+/**
+ * @brief Expands the threshold matrix of the pipeline into strips.
+ * @param pipeline The stages to apply.
+ * @param samples Samples per pixel in an image row.
+ */
+static THRESHOLD_STRIPS pipeline_strips(const PIPELINE &pipeline,
+                                        uint samples) {
+  return pipeline.mask ? threshold_strips(*pipeline.mask, samples)
+                       : threshold_strips(pipeline.size, samples);
+}
+
+/**
+ * @brief Applies the contrast and brightness stages in place.
+ * @param image The image to be adjusted.
+ * @param pipeline The stages to apply.
+ */
+void adjust(Image &image, const PIPELINE &pipeline) {
+  if (pipeline.contrast != 1) {
+    image *= pipeline.contrast;
+  }
+  if (pipeline.brightness != 0) {
+    image += pipeline.brightness;
+  }
+}
+
+/**
+ * @brief Converts the image to black and white if asked and applies the
+ * contrast and brightness stages.
+ * @param image The image to be prepared.
+ * @param pipeline The stages to apply.
+ */
+static void prepare(Image &image, const PIPELINE &pipeline) {
+  // if bw convert image to black and white, unless it was decoded as such
+  if (pipeline.bw && image.channels() > 1) {
+    image = image.rgb_2_gray();
+  }
+  adjust(image, pipeline);
+}
+
+/**
+ * @brief Returns the threshold strips of the pipeline for the layout of an
+ * image.
+ * @param image The image to be dithered.
+ * @param pipeline The stages to apply.
+ */
+static THRESHOLD_STRIPS image_strips(const Image &image,
+                                     const PIPELINE &pipeline) {
+  return pipeline_strips(pipeline,
+                         image.layout() == PLANAR ? 1 : image.channels());
+}
+
+/**
+ * @brief Runs the error diffusion stage in place.
+ * @param image The image to be diffused.
+ * @param pipeline The stages to apply.
+ */
+static void diffuse(Image &image, const PIPELINE &pipeline) {
+  double threshold = pipeline.threshold;
+  if (pipeline.auto_threshold) {
+    // adaptive threshold from the histogram of the image
+    threshold = otsu_threshold(statistics(image).combined());
+  }
+  if (pipeline.kernel == CUSTOM) {
+    error_diffusion_inplace(image, pipeline.custom, pipeline.isMBVQ,
+                            threshold, pipeline.threads, pipeline.fixed);
+  } else {
+    error_diffusion_inplace(image, pipeline.kernel, pipeline.isMBVQ,
+                            threshold, pipeline.threads, pipeline.fixed);
+  }
+}
+
+/**
+ * @brief Runs all stages of the pipeline on an image in memory.
+ * @param image The image to be processed, replaced by the result.
+ * @param pipeline The stages to apply.
+ */
+void process(Image &image, const PIPELINE &pipeline) {
+  prepare(image, pipeline);
+  if (pipeline.op == DITHERING) {
+    dither_inplace(image, image_strips(image, pipeline), 0, pipeline.threads);
+    return;
+  }
+  diffuse(image, pipeline);
+}
+
+/**
+ * @brief Runs all stages of the pipeline on an image in memory and returns
+ * the halftone as bits.
+ * @param image The image to be processed, used as working buffer.
+ * @param bits Receives the halftone.
+ * @param pipeline The stages to apply.
+ */
+void process(Image &image, BitImage &bits, const PIPELINE &pipeline) {
+  prepare(image, pipeline);
+  if (pipeline.op == DITHERING) {
+    dither(image, bits, image_strips(image, pipeline), 0, pipeline.threads);
+    return;
+  }
+  diffuse(image, pipeline);
+  bits.resize(image.width(), image.height(), image.channels(),
+              image.layout());
+  for (uint i = 0; i < image.height(); i++) {
+    bits.pack_row(i, image, i);
+  }
+}
+
+/**
+ * @brief Runs all stages of the pipeline while streaming rows from the input
+ * JPG to the output image.
+ * @param input Path to the input JPG image.
+ * @param output Path to save the output image.
+ * @param pipeline The stages to apply.
+ */
+bool process_stream(const std::string &input, const std::string &output,
+                    const PIPELINE &pipeline) {
+  if (pipeline.op == ERROR_DIFFUSION && pipeline.auto_threshold) {
+    throw std::invalid_argument(
+        "Argument `threshold=auto` is not supported with `stream`");
+  }
+  JpegReader reader;
+  if (!reader.open(input, pipeline.scale, pipeline.fast_dct, pipeline.bw)) {
+    return false;
+  }
+  const uint width = reader.width(), height = reader.height();
+  const uint channels = pipeline.bw ? 1 : reader.channels();
+  // halftones are kept and written as bits for PBM or PAM outputs
+  const OUTPUT_FORMAT format = output_format(output);
+  // written to a temporary file that replaces the output once complete
+  const std::string partial = partial_output(output);
+  JpegWriter writer;
+  BilevelWriter bilevel;
+  Image batch(width, STREAM_BATCH_ROWS, reader.channels());
+  Image gray, line(width, 1, channels);
+  BitImage bits, bit_line(width, 1, channels);
+  THRESHOLD_STRIPS strips;
+  std::unique_ptr<ErrorDiffuser> diffuser;
+  if (pipeline.op == DITHERING) {
+    strips = pipeline_strips(pipeline, channels);
+  } else if (pipeline.kernel == CUSTOM) {
+    diffuser.reset(new ErrorDiffuser(width, height, channels, pipeline.custom,
+                                     pipeline.isMBVQ, pipeline.threshold, 0,
+                                     pipeline.fixed));
+  } else {
+    diffuser.reset(new ErrorDiffuser(width, height, channels, pipeline.kernel,
+                                     pipeline.isMBVQ, pipeline.threshold, 0,
+                                     pipeline.fixed));
+  }
+  try {
+    if (format == JPG
+            ? !writer.open(partial, width, height, 75, channels == 1 ? 1 : 3)
+            : !bilevel.open(partial, width, height, channels, format)) {
+      return false;
+    }
+    while (reader.scanline() < height) {
+      const uint first = reader.scanline();
+      const uint rows = reader.read(batch, 0, STREAM_BATCH_ROWS);
+      if (rows == 0) {
+        break;
+      }
+      Image &work = pipeline.bw && batch.channels() > 1
+                        ? (gray = batch.rgb_2_gray())
+                        : batch;
+      adjust(work, pipeline);
+      if (pipeline.op == DITHERING && format == JPG) {
+        dither_inplace(work, strips, first, pipeline.threads);
+        writer.write(work, 0, rows);
+        continue;
+      }
+      if (pipeline.op == DITHERING) {
+        dither(work, bits, strips, first, pipeline.threads);
+        bilevel.write(bits, 0, rows);
+        continue;
+      }
+      for (uint r = 0; r < rows; r++) {
+        diffuser->push(work, r);
+        while (diffuser->ready()) {
+          if (format == JPG) {
+            diffuser->pop(line, 0);
+            writer.write(line, 0, 1);
+          } else {
+            diffuser->pop(bit_line, 0);
+            bilevel.write(bit_line, 0, 1);
+          }
+        }
+      }
+    }
+    // the end of the input is checked before the output is finished
+    reader.close();
+    writer.close();
+    bilevel.close();
+    finish_output(partial, output, true);
+  } catch (const std::exception &) {
+    reader.close();
+    writer.close();
+    bilevel.close();
+    finish_output(partial, output, false);
+    throw;
+  }
+  return true;
+}
@@ -0,0 +1,600 @@
+#include "simd.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+typedef unsigned char BYTE;
+
+/**
+ * @brief Saturating element-wise addition, dst = min(a + b, 255).
+ */
+void add_saturate(const BYTE *a, const BYTE *b, BYTE *dst, size_t n) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_adds_epu8(va, vb));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu8(va, vb));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = std::min(a[i] + b[i], 255);
+  }
+}
+
+/**
+ * @brief Saturating element-wise subtraction, dst = max(a - b, 0).
+ */
+void sub_saturate(const BYTE *a, const BYTE *b, BYTE *dst, size_t n) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_subs_epu8(va, vb));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_subs_epu8(va, vb));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = std::max(a[i] - b[i], 0);
+  }
+}
+
+/**
+ * @brief Adds a constant with saturation, dst = clamp(src + value, 0, 255).
+ */
+void add_scalar_saturate(const BYTE *src, int value, BYTE *dst, size_t n) {
+  // any offset outside of [-255, 255] saturates every element
+  value = std::max(-255, std::min(value, 255));
+  const BYTE magnitude = value < 0 ? -value : value;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i v32 = _mm256_set1_epi8((char)magnitude);
+  for (; i + 32 <= n; i += 32) {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(src + i));
+    vs = value < 0 ? _mm256_subs_epu8(vs, v32) : _mm256_adds_epu8(vs, v32);
+    _mm256_storeu_si256((__m256i *)(dst + i), vs);
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i v16 = _mm_set1_epi8((char)magnitude);
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(src + i));
+    vs = value < 0 ? _mm_subs_epu8(vs, v16) : _mm_adds_epu8(vs, v16);
+    _mm_storeu_si128((__m128i *)(dst + i), vs);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = std::max(0, std::min(src[i] + value, 255));
+  }
+}
+
+/**
+ * @brief Multiplies by a constant with saturation,
+ * dst = clamp(src * factor, 0, 255).
+ */
+void scale_saturate(const BYTE *src, int factor, BYTE *dst, size_t n) {
+  // with factor in [0, 255] every product fits an unsigned 16-bit lane
+  factor = std::max(0, std::min(factor, 255));
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i f32 = _mm256_set1_epi16((short)factor);
+  const __m256i max32 = _mm256_set1_epi16(255);
+  const __m256i zero32 = _mm256_setzero_si256();
+  for (; i + 32 <= n; i += 32) {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(vs, zero32), f32);
+    __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(vs, zero32), f32);
+    // min(x, 255) == x - max(x - 255, 0) for unsigned 16-bit lanes
+    lo = _mm256_sub_epi16(lo, _mm256_subs_epu16(lo, max32));
+    hi = _mm256_sub_epi16(hi, _mm256_subs_epu16(hi, max32));
+    // unpack and pack both work per 128-bit lane, so the order is preserved
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i f16 = _mm_set1_epi16((short)factor);
+  const __m128i max16 = _mm_set1_epi16(255);
+  const __m128i zero16 = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(vs, zero16), f16);
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(vs, zero16), f16);
+    lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, max16));
+    hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, max16));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = std::min(src[i] * factor, 255);
+  }
+}
+
+/**
+ * @brief Finds the minimum and maximum of a range in one pass.
+ */
+void min_max(const BYTE *src, size_t n, BYTE &min, BYTE &max) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128i vmin = _mm_set1_epi8((char)min);
+  __m128i vmax = _mm_set1_epi8((char)max);
+#if defined(__AVX2__)
+  if (n >= 32) {
+    __m256i wmin = _mm256_set1_epi8((char)min);
+    __m256i wmax = _mm256_set1_epi8((char)max);
+    for (; i + 32 <= n; i += 32) {
+      __m256i vs = _mm256_loadu_si256((const __m256i *)(src + i));
+      wmin = _mm256_min_epu8(wmin, vs);
+      wmax = _mm256_max_epu8(wmax, vs);
+    }
+    vmin = _mm_min_epu8(_mm256_castsi256_si128(wmin),
+                        _mm256_extracti128_si256(wmin, 1));
+    vmax = _mm_max_epu8(_mm256_castsi256_si128(wmax),
+                        _mm256_extracti128_si256(wmax, 1));
+  }
+#endif
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(src + i));
+    vmin = _mm_min_epu8(vmin, vs);
+    vmax = _mm_max_epu8(vmax, vs);
+  }
+  alignas(16) BYTE lanes_min[16], lanes_max[16];
+  _mm_store_si128((__m128i *)lanes_min, vmin);
+  _mm_store_si128((__m128i *)lanes_max, vmax);
+  for (int l = 0; l < 16; l++) {
+    min = std::min(min, lanes_min[l]);
+    max = std::max(max, lanes_max[l]);
+  }
+#endif
+  for (; i < n; i++) {
+    min = std::min(min, src[i]);
+    max = std::max(max, src[i]);
+  }
+}
+
+// Y = (257 * R + 504 * G + 98 * B) / 1000 + 16 is evaluated as
+// ((257 * R + 504 * G + 98 * B) >> 3) / 125 + 16, where the division by 125
+// is a multiply-high by GRAY_MAGIC followed by a shift by GRAY_SHIFT; this is
+// exact for all sums up to 255 * 859.
+static const int GRAY_MAGIC = 33555;
+static const int GRAY_SHIFT = 6;
+
+/**
+ * @brief Scalar grayscale conversion of a single pixel.
+ */
+static inline BYTE gray_pixel(int R, int G, int B) {
+  return (257 * R + 504 * G + 98 * B) / 1000 + 16;
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Converts 16 pixels held in separate R, G and B vectors to grayscale.
+ */
+static inline __m128i gray_epu8(__m128i R, __m128i G, __m128i B) {
+  const __m128i zero = _mm_setzero_si128();
+  // madd pairs (R, G) with (257, 504) and (B, 0) with (98, 0)
+  const __m128i crg = _mm_set1_epi32((504 << 16) | 257);
+  const __m128i cb = _mm_set1_epi32(98);
+  const __m128i magic = _mm_set1_epi16((short)GRAY_MAGIC);
+  const __m128i offset = _mm_set1_epi16(16);
+  __m128i res[2];
+  for (int h = 0; h < 2; h++) {
+    __m128i R16 = h ? _mm_unpackhi_epi8(R, zero) : _mm_unpacklo_epi8(R, zero);
+    __m128i G16 = h ? _mm_unpackhi_epi8(G, zero) : _mm_unpacklo_epi8(G, zero);
+    __m128i B16 = h ? _mm_unpackhi_epi8(B, zero) : _mm_unpacklo_epi8(B, zero);
+    __m128i lo = _mm_add_epi32(
+        _mm_madd_epi16(_mm_unpacklo_epi16(R16, G16), crg),
+        _mm_madd_epi16(_mm_unpacklo_epi16(B16, zero), cb));
+    __m128i hi = _mm_add_epi32(
+        _mm_madd_epi16(_mm_unpackhi_epi16(R16, G16), crg),
+        _mm_madd_epi16(_mm_unpackhi_epi16(B16, zero), cb));
+    __m128i sum = _mm_packs_epi32(_mm_srli_epi32(lo, 3), _mm_srli_epi32(hi, 3));
+    res[h] = _mm_add_epi16(
+        _mm_srli_epi16(_mm_mulhi_epu16(sum, magic), GRAY_SHIFT), offset);
+  }
+  return _mm_packus_epi16(res[0], res[1]);
+}
+#endif
+
+#if defined(__AVX2__)
+/**
+ * @brief Converts 32 pixels held in separate R, G and B vectors to grayscale.
+ * Every instruction works within 128-bit lanes, so the pixel order is kept.
+ */
+static inline __m256i gray_epu8(__m256i R, __m256i G, __m256i B) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i crg = _mm256_set1_epi32((504 << 16) | 257);
+  const __m256i cb = _mm256_set1_epi32(98);
+  const __m256i magic = _mm256_set1_epi16((short)GRAY_MAGIC);
+  const __m256i offset = _mm256_set1_epi16(16);
+  __m256i res[2];
+  for (int h = 0; h < 2; h++) {
+    __m256i R16 =
+        h ? _mm256_unpackhi_epi8(R, zero) : _mm256_unpacklo_epi8(R, zero);
+    __m256i G16 =
+        h ? _mm256_unpackhi_epi8(G, zero) : _mm256_unpacklo_epi8(G, zero);
+    __m256i B16 =
+        h ? _mm256_unpackhi_epi8(B, zero) : _mm256_unpacklo_epi8(B, zero);
+    __m256i lo = _mm256_add_epi32(
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(R16, G16), crg),
+        _mm256_madd_epi16(_mm256_unpacklo_epi16(B16, zero), cb));
+    __m256i hi = _mm256_add_epi32(
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(R16, G16), crg),
+        _mm256_madd_epi16(_mm256_unpackhi_epi16(B16, zero), cb));
+    __m256i sum = _mm256_packs_epi32(_mm256_srli_epi32(lo, 3),
+                                     _mm256_srli_epi32(hi, 3));
+    res[h] = _mm256_add_epi16(
+        _mm256_srli_epi16(_mm256_mulhi_epu16(sum, magic), GRAY_SHIFT), offset);
+  }
+  return _mm256_packus_epi16(res[0], res[1]);
+}
+#endif
+
+#if defined(__SSSE3__)
+/**
+ * @brief Splits 16 interleaved RGB pixels (48 bytes) into R, G and B vectors.
+ */
+static inline void deinterleave_rgb(const BYTE *src, __m128i &R, __m128i &G,
+                                    __m128i &B) {
+  // byte 3 * p + ch of the source goes to position p of channel ch
+  const __m128i a = _mm_loadu_si128((const __m128i *)src);
+  const __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+  const __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+  R = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8,
+                                            11, 14, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        -1, 1, 4, 7, 10, 13)));
+  G = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12,
+                                            15, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        -1, 2, 5, 8, 11, 14)));
+  B = _mm_or_si128(
+      _mm_or_si128(
+          _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, -1)),
+          _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10,
+                                            13, -1, -1, -1, -1, -1, -1))),
+      _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+/**
+ * @brief Converts interleaved RGB samples to grayscale.
+ */
+void rgb_to_gray(const BYTE *rgb, BYTE *gray, size_t n) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m128i R0, G0, B0, R1, G1, B1;
+    deinterleave_rgb(rgb + 3 * i, R0, G0, B0);
+    deinterleave_rgb(rgb + 3 * i + 48, R1, G1, B1);
+    __m256i R = _mm256_inserti128_si256(_mm256_castsi128_si256(R0), R1, 1);
+    __m256i G = _mm256_inserti128_si256(_mm256_castsi128_si256(G0), G1, 1);
+    __m256i B = _mm256_inserti128_si256(_mm256_castsi128_si256(B0), B1, 1);
+    _mm256_storeu_si256((__m256i *)(gray + i), gray_epu8(R, G, B));
+  }
+#endif
+#if defined(__SSSE3__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i R, G, B;
+    deinterleave_rgb(rgb + 3 * i, R, G, B);
+    _mm_storeu_si128((__m128i *)(gray + i), gray_epu8(R, G, B));
+  }
+#endif
+  for (; i < n; i++) {
+    gray[i] = gray_pixel(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+  }
+}
+
+/**
+ * @brief Converts separate R, G and B planes to grayscale.
+ */
+void planes_to_gray(const BYTE *R, const BYTE *G, const BYTE *B, BYTE *gray,
+                    size_t n) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m256i vr = _mm256_loadu_si256((const __m256i *)(R + i));
+    __m256i vg = _mm256_loadu_si256((const __m256i *)(G + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(B + i));
+    _mm256_storeu_si256((__m256i *)(gray + i), gray_epu8(vr, vg, vb));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i vr = _mm_loadu_si128((const __m128i *)(R + i));
+    __m128i vg = _mm_loadu_si128((const __m128i *)(G + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(B + i));
+    _mm_storeu_si128((__m128i *)(gray + i), gray_epu8(vr, vg, vb));
+  }
+#endif
+  for (; i < n; i++) {
+    gray[i] = gray_pixel(R[i], G[i], B[i]);
+  }
+}
+
+/**
+ * @brief Converts the full range luma of a JPG to grayscale.
+ */
+void luma_to_gray(const BYTE *luma, BYTE *gray, size_t n) {
+  // a neutral pixel with R = G = B = Y has the luma Y
+  planes_to_gray(luma, luma, luma, gray, n);
+}
+
+/**
+ * @brief Binarizes a range against per-element thresholds,
+ * dst = src > thresholds ? 255 : 0.
+ */
+void threshold_row(const BYTE *src, const BYTE *thresholds, BYTE *dst,
+                   size_t n) {
+  size_t i = 0;
+  // src > t exactly when the saturating difference src - t is not zero
+#if defined(__AVX2__)
+  const __m256i zero32 = _mm256_setzero_si256();
+  const __m256i ones32 = _mm256_set1_epi8((char)0xFF);
+  for (; i + 32 <= n; i += 32) {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i vt = _mm256_loadu_si256((const __m256i *)(thresholds + i));
+    __m256i le = _mm256_cmpeq_epi8(_mm256_subs_epu8(vs, vt), zero32);
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(le, ones32));
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i zero16 = _mm_setzero_si128();
+  const __m128i ones16 = _mm_set1_epi8((char)0xFF);
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i vt = _mm_loadu_si128((const __m128i *)(thresholds + i));
+    __m128i le = _mm_cmpeq_epi8(_mm_subs_epu8(vs, vt), zero16);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(le, ones16));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = src[i] > thresholds[i] ? 255 : 0;
+  }
+}
+
+#if defined(__SSSE3__)
+/**
+ * @brief Returns the sign bits of 16 bytes, the first byte in the most
+ * significant bit of the first output byte.
+ */
+static inline uint16_t sign_bits16(__m128i v) {
+  // movemask collects the sign bits with the first byte in the lowest bit,
+  // so every group of 8 bytes is reversed first
+  const __m128i reverse =
+      _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  return _mm_movemask_epi8(_mm_shuffle_epi8(v, reverse));
+}
+#endif
+
+#if defined(__AVX2__)
+/**
+ * @brief Returns the sign bits of 32 bytes like sign_bits16().
+ */
+static inline uint32_t sign_bits32(__m256i v) {
+  const __m256i reverse = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+      1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  return _mm256_movemask_epi8(_mm256_shuffle_epi8(v, reverse));
+}
+#endif
+
+/**
+ * @brief Packs bilevel samples into bits, most significant bit first, with a
+ * bit set for samples below 128.
+ * @param src Source samples.
+ * @param dst Destination of (n + 7) / 8 bytes.
+ * @param n Number of samples.
+ */
+void pack_bits(const BYTE *src, BYTE *dst, size_t n) {
+  size_t i = 0;
+  // the dark samples are the ones whose sign bit is clear
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    const uint32_t bits =
+        ~sign_bits32(_mm256_loadu_si256((const __m256i *)(src + i)));
+    std::memcpy(dst + i / 8, &bits, 4);
+  }
+#endif
+#if defined(__SSSE3__)
+  for (; i + 16 <= n; i += 16) {
+    const uint16_t bits =
+        ~sign_bits16(_mm_loadu_si128((const __m128i *)(src + i)));
+    std::memcpy(dst + i / 8, &bits, 2);
+  }
+#endif
+  for (; i < n; i += 8) {
+    BYTE bits = 0;
+    for (size_t b = 0; b < 8; b++) {
+      bits = (bits << 1) | (i + b < n && src[i + b] < 128);
+    }
+    dst[i / 8] = bits;
+  }
+}
+
+/**
+ * @brief Packs interleaved RGB samples into one bit plane per channel.
+ * @param rgb Source, 3 * n samples.
+ * @param R Destination of the red bits.
+ * @param G Destination of the green bits.
+ * @param B Destination of the blue bits.
+ * @param n Number of pixels.
+ */
+void pack_rgb_bits(const BYTE *rgb, BYTE *R, BYTE *G, BYTE *B, size_t n) {
+  size_t i = 0;
+#if defined(__SSSE3__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i r, g, b;
+    deinterleave_rgb(rgb + 3 * i, r, g, b);
+    const uint16_t bits[3] = {(uint16_t)~sign_bits16(r),
+                              (uint16_t)~sign_bits16(g),
+                              (uint16_t)~sign_bits16(b)};
+    std::memcpy(R + i / 8, &bits[0], 2);
+    std::memcpy(G + i / 8, &bits[1], 2);
+    std::memcpy(B + i / 8, &bits[2], 2);
+  }
+#endif
+  BYTE *planes[3] = {R, G, B};
+  for (; i < n; i += 8) {
+    for (size_t k = 0; k < 3; k++) {
+      BYTE bits = 0;
+      for (size_t b = 0; b < 8; b++) {
+        bits = (bits << 1) | (i + b < n && rgb[3 * (i + b) + k] < 128);
+      }
+      planes[k][i / 8] = bits;
+    }
+  }
+}
+
+/**
+ * @brief Binarizes a range against per-element thresholds into bits, with a
+ * bit set where src <= thresholds.
+ * @param src Source.
+ * @param thresholds Threshold of every element.
+ * @param dst Destination of (n + 7) / 8 bytes.
+ * @param n Number of elements.
+ */
+void threshold_bits(const BYTE *src, const BYTE *thresholds, BYTE *dst,
+                    size_t n) {
+  size_t i = 0;
+  // src <= t exactly when the saturating difference src - t is zero
+#if defined(__AVX2__)
+  const __m256i zero32 = _mm256_setzero_si256();
+  for (; i + 32 <= n; i += 32) {
+    __m256i vs = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i vt = _mm256_loadu_si256((const __m256i *)(thresholds + i));
+    const uint32_t bits =
+        sign_bits32(_mm256_cmpeq_epi8(_mm256_subs_epu8(vs, vt), zero32));
+    std::memcpy(dst + i / 8, &bits, 4);
+  }
+#endif
+#if defined(__SSSE3__)
+  const __m128i zero16 = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i vt = _mm_loadu_si128((const __m128i *)(thresholds + i));
+    const uint16_t bits =
+        sign_bits16(_mm_cmpeq_epi8(_mm_subs_epu8(vs, vt), zero16));
+    std::memcpy(dst + i / 8, &bits, 2);
+  }
+#endif
+  for (; i < n; i += 8) {
+    BYTE bits = 0;
+    for (size_t b = 0; b < 8; b++) {
+      bits = (bits << 1) | (i + b < n && src[i + b] <= thresholds[i + b]);
+    }
+    dst[i / 8] = bits;
+  }
+}
+
+/**
+ * @brief Expands bits into bilevel samples, dst = bit ? 0 : 255.
+ * @param src Source of (n + 7) / 8 bytes.
+ * @param dst Destination samples.
+ * @param n Number of samples.
+ */
+void unpack_bits(const BYTE *src, BYTE *dst, size_t n) {
+  size_t i = 0;
+  // every byte is broadcast to 8 lanes, each of which tests one bit
+#if defined(__AVX2__)
+  const __m256i spread32 = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i select32 = _mm256_setr_epi8(
+      -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1, -128, 64,
+      32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+  for (; i + 32 <= n; i += 32) {
+    uint32_t bits;
+    std::memcpy(&bits, src + i / 8, 4);
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), spread32);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, select32),
+                          _mm256_setzero_si256());
+    _mm256_storeu_si256((__m256i *)(dst + i), v);
+  }
+#endif
+#if defined(__SSSE3__)
+  const __m128i spread16 =
+      _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  const __m128i select16 = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128,
+                                         64, 32, 16, 8, 4, 2, 1);
+  for (; i + 16 <= n; i += 16) {
+    uint16_t bits;
+    std::memcpy(&bits, src + i / 8, 2);
+    __m128i v = _mm_shuffle_epi8(_mm_cvtsi32_si128(bits), spread16);
+    v = _mm_cmpeq_epi8(_mm_and_si128(v, select16), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)(dst + i), v);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (src[i / 8] >> (7 - i % 8)) & 1 ? 0 : 255;
+  }
+}
+
+/**
+ * @brief Splits the bits of interleaved RGB samples into one bit plane per
+ * channel.
+ * @param bits Source of (3 * n + 7) / 8 bytes.
+ * @param R Destination of the red bits.
+ * @param G Destination of the green bits.
+ * @param B Destination of the blue bits.
+ * @param n Number of pixels.
+ */
+void split_rgb_bits(const BYTE *bits, BYTE *R, BYTE *G, BYTE *B, size_t n) {
+  size_t i = 0;
+#if defined(__BMI2__)
+  // 16 pixels are 48 bits, read as a big-endian number whose bit 47 is the
+  // first sample, so every channel is extracted with one pext
+  const uint64_t mask = 0x924924924924ull; // bits 47, 44, ..., 2
+  for (; i + 16 <= n; i += 16) {
+    const BYTE *src = bits + i / 8 * 3;
+    const uint64_t word = (uint64_t)src[0] << 40 | (uint64_t)src[1] << 32 |
+                          (uint64_t)src[2] << 24 | (uint64_t)src[3] << 16 |
+                          (uint64_t)src[4] << 8 | src[5];
+    // the first pixel is the high byte of every 16-bit result
+    const uint16_t r = __builtin_bswap16(_pext_u64(word, mask));
+    const uint16_t g = __builtin_bswap16(_pext_u64(word, mask >> 1));
+    const uint16_t b = __builtin_bswap16(_pext_u64(word, mask >> 2));
+    std::memcpy(R + i / 8, &r, 2);
+    std::memcpy(G + i / 8, &g, 2);
+    std::memcpy(B + i / 8, &b, 2);
+  }
+#endif
+  BYTE *planes[3] = {R, G, B};
+  for (; i < n; i += 8) {
+    for (size_t k = 0; k < 3; k++) {
+      BYTE plane = 0;
+      for (size_t b = 0; b < 8; b++) {
+        const size_t m = 3 * (i + b) + k;
+        plane = (plane << 1) | (i + b < n && (bits[m / 8] >> (7 - m % 8)) & 1);
+      }
+      planes[k][i / 8] = plane;
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#include "statistics.h"
+#include "Image.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+typedef unsigned int uint;
+
+// Number of interleaved sub-histograms per channel
+static const uint SUB_HISTOGRAMS = 4;
+
+/**
+ * @brief Returns the histogram of all channels combined.
+ */
+HISTOGRAM STATISTICS::combined() const {
+  HISTOGRAM res = {};
+  for (const HISTOGRAM &channel : this->histogram) {
+    for (uint v = 0; v < 256; v++) {
+      res[v] += channel[v];
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Computes min, max, mean and histogram of every channel of an image.
+ * @param image The image to be analysed.
+ * @return STATISTICS The per-channel statistics.
+ */
+STATISTICS statistics(const Image &image) {
+  const uint channels = image.channels();
+  const size_t step = image.step();
+  // 32-bit sub-tables keep the working set in L1, they are flushed into the
+  // 64-bit result before any of their counters can overflow
+  std::vector<std::array<uint32_t, 256>> tables(channels * SUB_HISTOGRAMS);
+  STATISTICS res;
+  res.histogram.assign(channels, HISTOGRAM());
+  auto flush = [&]() {
+    for (uint k = 0; k < channels; k++) {
+      for (uint s = 0; s < SUB_HISTOGRAMS; s++) {
+        std::array<uint32_t, 256> &table = tables[k * SUB_HISTOGRAMS + s];
+        for (uint v = 0; v < 256; v++) {
+          res.histogram[k][v] += table[v];
+        }
+        table.fill(0);
+      }
+    }
+  };
+  const uint64_t rows_per_flush =
+      image.width() ? UINT32_MAX / image.width() : 1;
+  uint64_t pending = 0;
+  for (uint i = 0; i < image.height(); i++) {
+    if (pending == rows_per_flush) {
+      flush();
+      pending = 0;
+    }
+    for (uint k = 0; k < channels; k++) {
+      const BYTE *row = image.row(i, k);
+      std::array<uint32_t, 256> *sub = &tables[k * SUB_HISTOGRAMS];
+      uint j = 0;
+      for (; j + SUB_HISTOGRAMS <= image.width(); j += SUB_HISTOGRAMS) {
+        sub[0][row[j * step]]++;
+        sub[1][row[(j + 1) * step]]++;
+        sub[2][row[(j + 2) * step]]++;
+        sub[3][row[(j + 3) * step]]++;
+      }
+      for (; j < image.width(); j++) {
+        sub[0][row[j * step]]++;
+      }
+    }
+    pending++;
+  }
+  flush();
+  // derive min, max and mean from the histograms
+  res.min.assign(channels, 0);
+  res.max.assign(channels, 0);
+  res.mean.assign(channels, 0.);
+  for (uint k = 0; k < channels; k++) {
+    const HISTOGRAM &histogram = res.histogram[k];
+    uint64_t count = 0, sum = 0;
+    bool first = true;
+    for (uint v = 0; v < 256; v++) {
+      if (histogram[v] == 0) {
+        continue;
+      }
+      if (first) {
+        res.min[k] = v;
+        first = false;
+      }
+      res.max[k] = v;
+      count += histogram[v];
+      sum += histogram[v] * v;
+    }
+    res.mean[k] = count ? (double)sum / count : 0.;
+  }
+  return res;
+}
+
+/**
+ * @brief Finds a threshold that separates a histogram into two classes
+ * using Otsu's method (maximum between-class variance).
+ * @param histogram The histogram to be split.
+ * @return BYTE The threshold.
+ */
+BYTE otsu_threshold(const HISTOGRAM &histogram) {
+  uint64_t total = 0;
+  double sum = 0.;
+  for (uint v = 0; v < 256; v++) {
+    total += histogram[v];
+    sum += (double)v * histogram[v];
+  }
+  uint64_t w0 = 0;
+  double sum0 = 0., best = 0.;
+  BYTE threshold = 127;
+  // class 0 holds the values [0, t] and class 1 the values [t + 1, 255]
+  for (uint t = 0; t < 255; t++) {
+    w0 += histogram[t];
+    sum0 += (double)t * histogram[t];
+    const uint64_t w1 = total - w0;
+    if (w0 == 0 || w1 == 0) {
+      continue;
+    }
+    const double mu0 = sum0 / w0, mu1 = (sum - sum0) / w1;
+    const double between = (double)w0 * w1 * (mu0 - mu1) * (mu0 - mu1);
+    if (between > best) {
+      best = between;
+      threshold = t + 1;
+    }
+  }
+  return threshold;
+}
@@ -0,0 +1,135 @@
+#include "Image.h"
+#include "error_diffusion.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Returns the mean of all samples of an image.
+ */
+static double mean_level(const Image &image) {
+  double sum = 0;
+  for (uint i = 0; i < image.height(); i++) {
+    for (uint j = 0; j < image.width(); j++) {
+      for (uint k = 0; k < image.channels(); k++) {
+        sum += image.get(i, j, k);
+      }
+    }
+  }
+  return sum / ((double)image.width() * image.height() * image.channels());
+}
+
+/**
+ * @brief Returns the fraction of samples that differ between two images of
+ * the same shape.
+ */
+static double differing(const Image &a, const Image &b) {
+  size_t count = 0;
+  for (uint i = 0; i < a.height(); i++) {
+    for (uint j = 0; j < a.width(); j++) {
+      for (uint k = 0; k < a.channels(); k++) {
+        count += a.get(i, j, k) != b.get(i, j, k);
+      }
+    }
+  }
+  return (double)count / ((double)a.width() * a.height() * a.channels());
+}
+
+/**
+ * @brief Returns how far the local tone of two halftones differs: the mean
+ * absolute difference of their 16 x 16 block averages, in levels.
+ */
+static double tone_difference(const Image &a, const Image &b) {
+  const uint block = 16;
+  double sum = 0;
+  size_t blocks = 0;
+  for (uint i = 0; i + block <= a.height(); i += block) {
+    for (uint j = 0; j + block <= a.width(); j += block) {
+      for (uint k = 0; k < a.channels(); k++) {
+        double difference = 0;
+        for (uint y = i; y < i + block; y++) {
+          for (uint x = j; x < j + block; x++) {
+            difference += (double)a.get(y, x, k) - b.get(y, x, k);
+          }
+        }
+        sum += std::fabs(difference) / (block * block);
+        blocks++;
+      }
+    }
+  }
+  return sum / blocks;
+}
+
+/**
+ * @brief Adds -1, 0 or +1 to every sample, the rounding noise of an 8-bit
+ * input.
+ */
+static Image add_noise(Image image, uint32_t seed) {
+  for (uint i = 0; i < image.height(); i++) {
+    for (uint j = 0; j < image.width(); j++) {
+      for (uint k = 0; k < image.channels(); k++) {
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        const int value = image.get(i, j, k) + (int)(seed % 3) - 1;
+        image.set(i, j, k, value < 0 ? 0 : (value > 255 ? 255 : value));
+      }
+    }
+  }
+  return image;
+}
+
+/**
+ * @brief Measures how far the fixed-point halftones are from the double
+ * ones for every built-in kernel, with and without MBVQ and --bw.
+ *
+ * Error diffusion feeds every decision back into the next ones, so the
+ * rounding of the fixed-point state moves dots around and a large share of
+ * the samples differs, just as after adding the rounding noise of the 8-bit
+ * input to the double path. What must not change is the tone: the mean level
+ * stays within 0.3 (0.6 for the unstable Floyd-Steinberg MBVQ) and the local
+ * tone differs no more than with that noise.
+ */
+int main() {
+  const Image photos[] = {test_image(640, 480, 3, 1),
+                          test_image(211, 317, 3, 7)};
+  const char *kernels[] = {"", "FLOYD_STEINBERG", "JARVIS_JUDICE_NINKE",
+                           "STUCKI"};
+  for (const Image &photo : photos) {
+    for (DIFFUSION_KERNEL kernel :
+         {FLOYD_STEINBERG, JARVIS_JUDICE_NINKE, STUCKI}) {
+      for (int mode = 0; mode < 3; mode++) {
+        // color, color with MBVQ, black and white
+        const bool isMBVQ = mode == 1;
+        const Image source = mode == 2 ? photo.rgb_2_gray() : photo;
+        Image exact = source, fixed = source, noisy = add_noise(source, 9);
+        error_diffusion_inplace(exact, kernel, isMBVQ, 127., 1, false);
+        error_diffusion_inplace(fixed, kernel, isMBVQ, 127., 1, true);
+        error_diffusion_inplace(noisy, kernel, isMBVQ, 127., 1, false);
+        const double level = std::fabs(mean_level(exact) - mean_level(fixed));
+        const double tone = tone_difference(exact, fixed);
+        const double noise_tone = tone_difference(exact, noisy);
+        const std::string name =
+            std::string(kernels[kernel]) +
+            (mode == 1 ? " mbvq" : (mode == 2 ? " bw" : "")) + " " +
+            std::to_string(photo.width()) + "x" +
+            std::to_string(photo.height());
+        std::cout << name << ": " << differing(exact, fixed) * 100
+                  << "% samples differ, mean level off by " << level
+                  << ", local tone by " << tone << " (input noise "
+                  << noise_tone << ")" << std::endl;
+        // the errors of Floyd-Steinberg with MBVQ grow to thousands of
+        // levels, its mean level moves by up to 0.5 with input noise alone
+        const double max_level =
+            kernel == FLOYD_STEINBERG && isMBVQ ? 0.6 : 0.3;
+        check(level <= max_level, name + ": mean level off by more than " +
+                                      std::to_string(max_level));
+        check(tone <= 1.25 * noise_tone,
+              name + ": local tone differs more than with input noise");
+      }
+    }
+  }
+  return check_status();
+}
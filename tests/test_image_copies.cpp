@@ -0,0 +1,77 @@
+#include "BitImage.h"
+#include "Image.h"
+#include "pipeline.h"
+#include "test_util.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Runs the steps of a CLI invocation on a JPG in memory and returns
+ * the number of image copies they made.
+ * @param jpg The input JPG.
+ * @param pipeline The stages to apply.
+ * @param bilevel Whether the output is a PBM or PAM instead of a JPG.
+ */
+static size_t cli_copies(const std::vector<BYTE> &jpg,
+                         const PIPELINE &pipeline, bool bilevel) {
+  Image::copies = 0;
+  Image image;
+  image.readJpg(jpg.data(), jpg.size(), pipeline.scale, pipeline.fast_dct,
+                pipeline.bw, pipeline.threads);
+  if (bilevel) {
+    BitImage bits;
+    process(image, bits, pipeline);
+  } else {
+    process(image, pipeline);
+    std::vector<BYTE> output;
+    image.writeJpg(output, 75, pipeline.threads);
+  }
+  return Image::copies;
+}
+
+int main() {
+  std::vector<BYTE> jpg;
+  test_image(320, 240, 3).writeJpg(jpg);
+
+  std::vector<std::pair<std::string, PIPELINE>> pipelines;
+  PIPELINE pipeline;
+  pipeline.op = DITHERING;
+  pipelines.push_back({"dithering", pipeline});
+  pipeline.size = 16;
+  pipeline.threads = 3;
+  pipelines.push_back({"dithering 16 threads", pipeline});
+  pipeline = PIPELINE();
+  pipeline.op = ERROR_DIFFUSION;
+  for (DIFFUSION_KERNEL kernel :
+       {FLOYD_STEINBERG, JARVIS_JUDICE_NINKE, STUCKI}) {
+    pipeline.kernel = kernel;
+    pipelines.push_back({"error diffusion " + std::to_string(kernel), pipeline});
+  }
+  pipeline.isMBVQ = true;
+  pipelines.push_back({"error diffusion mbvq", pipeline});
+  pipeline.isMBVQ = false;
+  pipeline.fixed = true;
+  pipeline.threads = 3;
+  pipelines.push_back({"error diffusion fixed threads", pipeline});
+  pipeline.fixed = false;
+  pipeline.auto_threshold = true;
+  pipelines.push_back({"error diffusion auto threshold", pipeline});
+  pipeline.brightness = 10;
+  pipeline.contrast = 2;
+  pipelines.push_back({"error diffusion adjusted", pipeline});
+
+  for (const auto &named : pipelines) {
+    for (bool bw : {false, true}) {
+      for (bool bilevel : {false, true}) {
+        PIPELINE run = named.second;
+        run.bw = bw;
+        const size_t copies = cli_copies(jpg, run, bilevel);
+        // large jobs pay for at most one buffer besides the decoded image
+        check(copies <= 1, named.first + (bw ? " bw" : "") +
+                               (bilevel ? " bilevel" : "") + ": " +
+                               std::to_string(copies) + " image copies");
+      }
+    }
+  }
+  return check_status();
+}
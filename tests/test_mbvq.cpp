@@ -0,0 +1,268 @@
+#include "diffusion_kernel.h"
+#include "error_diffusion.h"
+#include "test_util.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief get_nearest_vertex() before it was made branch-free.
+ */
+static COLOR reference_nearest_vertex(const MBVQ mbvq, const float R,
+                                      const float G, const float B) {
+  COLOR vertex;
+  if (mbvq == MBVQ::CMYW) {
+    vertex = COLOR::WHITE;
+    if (B < 0.5) {
+      if (B <= R) {
+        if (B <= G) {
+          vertex = COLOR::YELLOW;
+        }
+      }
+    }
+    if (G < 0.5) {
+      if (G <= B) {
+        if (G <= R) {
+          vertex = COLOR::MAGENTA;
+        }
+      }
+    }
+    if (R < 0.5) {
+      if (R <= B) {
+        if (R <= G) {
+          vertex = COLOR::CYAN;
+        }
+      }
+    }
+  }
+
+  if (mbvq == MBVQ::MYGC) {
+    vertex = COLOR::MAGENTA;
+    if (G >= B) {
+      if (R >= B) {
+        if (R >= 0.5) {
+          vertex = COLOR::YELLOW;
+        } else {
+          vertex = COLOR::GREEN;
+        }
+      }
+    }
+    if (G >= R) {
+      if (B >= R) {
+        if (B >= 0.5) {
+          vertex = COLOR::CYAN;
+        } else {
+          vertex = COLOR::GREEN;
+        }
+      }
+    }
+  }
+
+  if (mbvq == MBVQ::RGMY) {
+    if (B > 0.5) {
+      if (R > 0.5) {
+        if (B >= G) {
+          vertex = COLOR::MAGENTA;
+        } else {
+          vertex = COLOR::YELLOW;
+        }
+      } else {
+        if (G > B + R) {
+          vertex = COLOR::GREEN;
+        } else {
+          vertex = COLOR::MAGENTA;
+        }
+      }
+    } else {
+      if (R >= 0.5) {
+        if (G >= 0.5) {
+          vertex = COLOR::YELLOW;
+        } else {
+          vertex = COLOR::RED;
+        }
+      } else {
+        if (R >= G) {
+          vertex = COLOR::RED;
+        } else {
+          vertex = COLOR::GREEN;
+        }
+      }
+    }
+  }
+
+  if (mbvq == MBVQ::KRGB) {
+    vertex = COLOR::BLACK;
+    if (B > 0.5) {
+      if (B >= R) {
+        if (B >= G) {
+          vertex = COLOR::BLUE;
+        }
+      }
+    }
+    if (G > 0.5) {
+      if (G >= B) {
+        if (G >= R) {
+          vertex = COLOR::GREEN;
+        }
+      }
+    }
+    if (R > 0.5) {
+      if (R >= B) {
+        if (R >= G) {
+          vertex = COLOR::RED;
+        }
+      }
+    }
+  }
+
+  if (mbvq == MBVQ::RGBM) {
+    vertex = COLOR::GREEN;
+    if (R > G) {
+      if (R >= B) {
+        if (B < 0.5) {
+          vertex = COLOR::RED;
+        } else {
+          vertex = COLOR::MAGENTA;
+        }
+      }
+    }
+    if (B > G) {
+      if (B >= R) {
+        if (R < 0.5) {
+          vertex = COLOR::BLUE;
+        } else {
+          vertex = COLOR::MAGENTA;
+        }
+      }
+    }
+  }
+
+  if (mbvq == MBVQ::CMGB) {
+    if (B > 0.5) {
+      if (R > 0.5) {
+        if (G >= R) {
+          vertex = COLOR::CYAN;
+        } else {
+          vertex = COLOR::MAGENTA;
+        }
+      } else {
+        if (G > 0.5) {
+          vertex = COLOR::CYAN;
+        } else {
+          vertex = COLOR::BLUE;
+        }
+      }
+    } else {
+      if (R > 0.5) {
+        if (R - G + B >= 0.5) {
+          vertex = COLOR::MAGENTA;
+        } else {
+          vertex = COLOR::GREEN;
+        }
+      } else {
+        if (G >= B) {
+          vertex = COLOR::GREEN;
+        } else {
+          vertex = COLOR::BLUE;
+        }
+      }
+    }
+  }
+  return vertex;
+}
+
+
+/**
+ * @brief get_mbvq() before it was made branch-free, with the lower half
+ * tested as intended: ~(x > y) is always non-zero, so the original put every
+ * color with R + G <= 255 into KRGB.
+ */
+static MBVQ reference_mbvq(BYTE R, BYTE G, BYTE B) {
+  MBVQ res;
+  if (R + G > 255) {
+    if (G + B > 255) {
+      if (R + G + B > 510) {
+        res = MBVQ::CMYW;
+      } else {
+        res = MBVQ::MYGC;
+      }
+    } else {
+      res = MBVQ::RGMY;
+    }
+  } else {
+    if (!(G + B > 255)) {
+      if (!(R + G + B > 255)) {
+        res = MBVQ::KRGB;
+      } else {
+        res = MBVQ::RGBM;
+      }
+    } else {
+      res = MBVQ::CMGB;
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Compares get_nearest_vertex() with the reference for all MBVQs.
+ * @return bool Whether all six agree.
+ */
+static bool same_vertex(float R, float G, float B) {
+  for (int mbvq = MBVQ::CMYW; mbvq <= MBVQ::CMGB; mbvq++) {
+    if (get_nearest_vertex((MBVQ)mbvq, R, G, B) !=
+        reference_nearest_vertex((MBVQ)mbvq, R, G, B)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Validates the branch-free MBVQ quantization against the branchy
+ * functions it replaced.
+ *
+ * - get_mbvq() on all 2^24 RGB triples;
+ * - get_nearest_vertex() for all six MBVQs on a 384^3 grid of the colors
+ *   -64/255 to 319/255 that the diffused error produces around the cube, and
+ *   on 1e8 random colors from -0.5 to 1.5.
+ */
+int main() {
+  size_t mbvq_mismatches = 0;
+  for (uint rgb = 0; rgb < 1u << 24; rgb++) {
+    const BYTE R = rgb & 255, G = rgb >> 8 & 255, B = rgb >> 16;
+    mbvq_mismatches += get_mbvq(R, G, B) != reference_mbvq(R, G, B);
+  }
+  check(mbvq_mismatches == 0, "get_mbvq: " + std::to_string(mbvq_mismatches) +
+                                  " triples differ from the reference");
+
+  size_t grid_mismatches = 0;
+  for (int r = -64; r < 320; r++) {
+    for (int g = -64; g < 320; g++) {
+      for (int b = -64; b < 320; b++) {
+        grid_mismatches +=
+            !same_vertex((float)(r / 255.), (float)(g / 255.),
+                         (float)(b / 255.));
+      }
+    }
+  }
+  check(grid_mismatches == 0, "get_nearest_vertex: " +
+                                  std::to_string(grid_mismatches) +
+                                  " grid colors differ from the reference");
+
+  size_t random_mismatches = 0;
+  uint32_t state = 88172645u;
+  for (uint n = 0; n < 100000000u; n++) {
+    float rgb[3];
+    for (float &sample : rgb) {
+      // xorshift32, 24 random bits mapped to [-0.5, 1.5)
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      sample = (state >> 8) * (2.f / (1 << 24)) - 0.5f;
+    }
+    random_mismatches += !same_vertex(rgb[0], rgb[1], rgb[2]);
+  }
+  check(random_mismatches == 0, "get_nearest_vertex: " +
+                                    std::to_string(random_mismatches) +
+                                    " random colors differ from the reference");
+  return check_status();
+}
@@ -0,0 +1,71 @@
+#include "Image.h"
+#include "test_util.h"
+#include <string>
+
+/**
+ * @brief The double precision conversion that rgb_2_gray() replaced.
+ */
+static BYTE reference_gray(BYTE R, BYTE G, BYTE B) {
+  return 0.257 * R + 0.504 * G + 0.098 * B + 16;
+}
+
+/**
+ * @brief Converts an image and compares every pixel with reference_gray().
+ * @param image RGB image.
+ * @param name Name of the case.
+ * @return size_t Number of pixels 1 above the reference, other differences
+ *         fail the test.
+ */
+static size_t compare(const Image &image, const std::string &name) {
+  const Image gray = image.rgb_2_gray();
+  size_t above = 0, other = 0;
+  for (uint i = 0; i < image.height(); i++) {
+    for (uint j = 0; j < image.width(); j++) {
+      const int expected = reference_gray(
+          image.get(i, j, 0), image.get(i, j, 1), image.get(i, j, 2));
+      const int actual = gray.get(i, j, 0);
+      above += actual == expected + 1;
+      other += actual != expected && actual != expected + 1;
+    }
+  }
+  check(gray.channels() == 1 && gray.width() == image.width() &&
+            gray.height() == image.height(),
+        name + ": shape");
+  check(other == 0, name + ": " + std::to_string(other) +
+                        " pixels differ by more than +1");
+  return above;
+}
+
+int main() {
+  // every RGB triple once, on SIMD-sized rows
+  Image all(4096, 4096, 3);
+  for (uint i = 0; i < 4096; i++) {
+    for (uint j = 0; j < 4096; j++) {
+      const uint rgb = i << 12 | j;
+      all.set(i, j, 0, rgb & 255);
+      all.set(i, j, 1, rgb >> 8 & 255);
+      all.set(i, j, 2, rgb >> 16);
+    }
+  }
+  const size_t above = compare(all, "all triples");
+  check(above == 366, "all triples: " + std::to_string(above) +
+                          " pixels differ by +1, 366 documented");
+
+  // vector tails and the planar path
+  for (uint width : {1u, 15u, 17u, 33u, 1001u}) {
+    for (LAYOUT layout : {INTERLEAVED, PLANAR}) {
+      const Image noisy = test_image(width, 7, 3, width);
+      Image image(width, 7, 3, layout);
+      for (uint i = 0; i < 7; i++) {
+        for (uint j = 0; j < width; j++) {
+          for (uint k = 0; k < 3; k++) {
+            image.set(i, j, k, noisy.get(i, j, k));
+          }
+        }
+      }
+      compare(image, std::string(layout == PLANAR ? "planar" : "interleaved") +
+                         " width " + std::to_string(width));
+    }
+  }
+  return check_status();
+}
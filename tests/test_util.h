@@ -0,0 +1,72 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include "Image.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+ * @brief Returns the number of failed checks of the test program.
+ */
+inline int &check_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+/**
+ * @brief Records a check, printing its description if it failed.
+ * @param condition Whether the check passed.
+ * @param description What was checked.
+ */
+inline void check(bool condition, const std::string &description) {
+  if (!condition) {
+    std::cerr << "[FAIL] " << description << std::endl;
+    check_failures()++;
+  }
+}
+
+/**
+ * @brief Returns the exit status of the test program.
+ */
+inline int check_status() {
+  if (check_failures() > 0) {
+    std::cerr << check_failures() << " check(s) failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Makes a photo-like test image: smooth gradients with a little
+ * deterministic noise, so that every halftone level and MBVQ tetrahedron is
+ * visited.
+ * @param width Image width.
+ * @param height Image height.
+ * @param channels Number of channels, 1 or 3.
+ * @param seed Seed of the noise.
+ */
+inline Image test_image(uint width, uint height, uint channels,
+                        uint32_t seed = 1) {
+  Image image(width, height, channels);
+  uint32_t state = seed;
+  for (uint i = 0; i < height; i++) {
+    for (uint j = 0; j < width; j++) {
+      for (uint k = 0; k < channels; k++) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        const uint gradient =
+            k == 0 ? 255 * j / width
+                   : (k == 1 ? 255 * i / height
+                             : 255 * (i + j) / (width + height));
+        const int value = (int)gradient + (int)(state % 25) - 12;
+        image.set(i, j, k, value < 0 ? 0 : (value > 255 ? 255 : value));
+      }
+    }
+  }
+  return image;
+}
+
+#endif